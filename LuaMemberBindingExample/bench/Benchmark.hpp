@@ -0,0 +1,50 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+// Written to by benchmarks so the compiler can't drop the work they measure.
+inline volatile size_t BenchmarkSink = 0;
+
+// Calls body, which does operations operations per call, until at least MinimumTime has passed and prints the mean
+// time of one operation. One untimed call first lets caches, the allocator and the collector settle.
+template <typename TBody>
+double RunBenchmark(const std::string& name, size_t operations, TBody body)
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr auto MinimumTime = std::chrono::milliseconds(250);
+
+    body();
+
+    size_t calls = 0;
+    Clock::time_point start = Clock::now();
+    Clock::duration elapsed;
+    do
+    {
+        body();
+        ++calls;
+        elapsed = Clock::now() - start;
+    } while (elapsed < MinimumTime);
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(calls * operations);
+    std::printf("  %-56s %12.2f ns/op\n", name.c_str(), nanoseconds);
+    return nanoseconds;
+}
+
+// one per file, run from main in this order
+void BenchmarkMemberLookup();
+void BenchmarkIndexMode();
+void BenchmarkMethodBinding();
+void BenchmarkTypeCheck();
+void BenchmarkBytecodeCache();
+void BenchmarkStatePool();
+void BenchmarkSamplingProfiler();
+
+#endif
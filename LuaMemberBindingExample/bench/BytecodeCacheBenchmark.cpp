@@ -0,0 +1,51 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <filesystem>
+#include <string>
+#include <Benchmark.hpp>
+#include <LuaManager.hpp>
+
+namespace
+{
+    constexpr int FunctionCount = 2000;
+
+    // a large script that mostly defines functions, so compiling it dominates running it
+    std::string MakeScript()
+    {
+        std::string script = "local functions = {}\n";
+        for (int i = 0; i < FunctionCount; ++i)
+        {
+            std::string index = std::to_string(i);
+            script += "functions[" + index + "] = function(a, b)\n"
+                "    local sum = 0\n"
+                "    for j = a, b do if j % 3 == 0 then sum = sum + j * " + index + " else sum = sum - j end end\n"
+                "    return sum, tostring(sum) .. \"" + index + "\"\n"
+                "end\n";
+        }
+
+        return script;
+    }
+}
+
+// Cold start of a state running one large script, compiling it from source against loading the dumped bytecode.
+// The untimed first run fills the cache.
+void BenchmarkBytecodeCache()
+{
+    std::string script = MakeScript();
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "LuaMemberBindingBenchmarks";
+    std::filesystem::remove_all(directory);
+
+    RunBenchmark("new state + Execute, from source", 1, [&script]() {
+        LuaManager manager{};
+        manager.Execute(script);
+    });
+
+    RunBenchmark("new state + Execute, from bytecode cache", 1, [&script, &directory]() {
+        LuaManager manager{};
+        manager.EnableBytecodeCache(directory);
+        manager.Execute(script);
+    });
+
+    std::filesystem::remove_all(directory);
+}
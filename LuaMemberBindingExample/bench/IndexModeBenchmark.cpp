@@ -0,0 +1,56 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <string>
+#include <Benchmark.hpp>
+#include <ElementNode.hpp>
+#include <LuaManager.hpp>
+#include <LuaTypeRegistry.hpp>
+
+namespace
+{
+    constexpr int LuaIterations = 100000;
+
+    void BenchmarkMode(LuaIndexMode mode, const char* modeName, bool withField)
+    {
+        LuaTypeRegistry<ElementNode> registry("ElementNode");
+        registry.RegisterMethod<&ElementNode::Add>("Add");
+        if (withField)
+        {
+            registry.RegisterField("PointlessBool", &ElementNode::pointlessBool);
+        }
+        registry.Finalize();
+
+        LuaManager manager{};
+        manager.ApplyRegistry(registry, mode);
+        static_cast<void>(manager.Instantiate(registry));
+        manager.SetGlobal("node");
+
+        std::string loop = "local node = node for i = 1, " + std::to_string(LuaIterations) + " do ";
+        LuaManager::ChunkHandle calls = manager.Compile(loop + "node:Add(i, 5) end");
+        RunBenchmark(std::string("node:Add(i, 5), ") + modeName + (withField ? "" : ", no fields"), LuaIterations,
+            [&manager, calls]() {
+                manager.Run(calls);
+            });
+
+        if (!withField)
+        {
+            return;
+        }
+
+        LuaManager::ChunkHandle fields = manager.Compile(loop + "local value = node.PointlessBool end");
+        RunBenchmark(std::string("node.PointlessBool, ") + modeName, LuaIterations, [&manager, fields]() {
+            manager.Run(fields);
+        });
+    }
+}
+
+// Method calls through the all-in-C Dispatch __index against the MethodTable mode, where the VM finds methods in a
+// plain table: through a Lua __index function when the type has fields, or with the table as __index when it has
+// none. Field reads are shown too, as MethodTable puts a Lua call and a table probe in front of them.
+void BenchmarkIndexMode()
+{
+    BenchmarkMode(LuaIndexMode::Dispatch, "Dispatch", true);
+    BenchmarkMode(LuaIndexMode::MethodTable, "MethodTable", true);
+    BenchmarkMode(LuaIndexMode::MethodTable, "MethodTable", false);
+}
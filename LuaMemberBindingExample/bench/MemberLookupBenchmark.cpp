@@ -0,0 +1,58 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Benchmark.hpp>
+#include <LuaManager.hpp>
+#include <LuaTypeRegistry.hpp>
+
+namespace
+{
+    struct LookupNode
+    {
+        int32_t value;
+    };
+
+    constexpr size_t MemberCounts[] = {1, 4, 16, 64, 256};
+    constexpr int LuaIterations = 100000;
+}
+
+// Member resolution as the number of registered members grows, once through FindNamedMember alone and once through
+// a full node.Field access from Lua. Both should stay flat.
+void BenchmarkMemberLookup()
+{
+    for (size_t count : MemberCounts)
+    {
+        LuaTypeRegistry<LookupNode> registry("LookupNode");
+        std::vector<std::string> names;
+        for (size_t i = 0; i < count; ++i)
+        {
+            names.push_back("Field" + std::to_string(i));
+            registry.RegisterField(names.back(), &LookupNode::value);
+        }
+        registry.Finalize();
+
+        RunBenchmark("FindNamedMember, " + std::to_string(count) + " members", names.size(), [&registry, &names]() {
+            size_t found = 0;
+            for (const std::string& name : names)
+            {
+                found += registry.FindNamedMember(name).has_value() ? 1 : 0;
+            }
+            BenchmarkSink = found;
+        });
+
+        LuaManager manager{};
+        manager.ApplyRegistry(registry);
+        static_cast<void>(manager.Instantiate(registry));
+        manager.SetGlobal("node");
+
+        LuaManager::ChunkHandle chunk = manager.Compile("local node = node for i = 1, " + std::to_string(LuaIterations)
+            + " do local value = node." + names.back() + " end");
+        RunBenchmark("node." + names.back() + " from Lua, " + std::to_string(count) + " members", LuaIterations,
+            [&manager, chunk]() {
+                manager.Run(chunk);
+            });
+    }
+}
@@ -0,0 +1,52 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <string>
+#include <Benchmark.hpp>
+#include <ElementNode.hpp>
+#include <LuaManager.hpp>
+#include <LuaTypeRegistry.hpp>
+
+namespace
+{
+    constexpr int LuaIterations = 100000;
+
+    template <typename TRegister>
+    void BenchmarkBinding(const char* bindingName, TRegister registerAdd)
+    {
+        LuaTypeRegistry<ElementNode> registry("ElementNode");
+        registerAdd(registry);
+        registry.Finalize();
+
+        LuaManager manager{};
+        manager.ApplyRegistry(registry);
+        static_cast<void>(manager.Instantiate(registry));
+        manager.SetGlobal("node");
+
+        LuaManager::ChunkHandle chunk = manager.Compile(
+            "local node = node for i = 1, " + std::to_string(LuaIterations) + " do node:Add(i, 5) end");
+        RunBenchmark(std::string("node:Add(i, 5), ") + bindingName, LuaIterations, [&manager, chunk]() {
+            manager.Run(chunk);
+        });
+    }
+}
+
+// RegisterMethod<&ElementNode::Add> against the hand-written std::function binding it replaced.
+void BenchmarkMethodBinding()
+{
+    BenchmarkBinding("std::function lambda", [](LuaTypeRegistry<ElementNode>& registry) {
+        registry.RegisterMethod("Add", [](lua_State* L) {
+            ElementNode* node = static_cast<ElementNode*>(luaL_checkudata(L, 1, "ElementNode"));
+
+            lua_pushinteger(L,
+                node->Add(
+                    static_cast<int32_t>(luaL_checkinteger(L, 2)),
+                    static_cast<int32_t>(luaL_checkinteger(L, 3))));
+            return 1;
+        });
+    });
+
+    BenchmarkBinding("RegisterMethod<&ElementNode::Add>", [](LuaTypeRegistry<ElementNode>& registry) {
+        registry.RegisterMethod<&ElementNode::Add>("Add");
+    });
+}
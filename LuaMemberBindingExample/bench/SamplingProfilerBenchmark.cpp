@@ -0,0 +1,64 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <Benchmark.hpp>
+#include <ElementNode.hpp>
+#include <LuaManager.hpp>
+#include <LuaTypeRegistry.hpp>
+
+namespace
+{
+    constexpr int LuaIterations = 200000;
+
+    // Lua calls several frames deep with a bound C++ method at the bottom, so samples have real stacks to walk
+    constexpr const char* Script =
+        "local node = node\n"
+        "local function leaf(i) return node:Add(i, 5) end\n"
+        "local function middle(i) return leaf(i) + 1 end\n"
+        "local function outer(i) return middle(i) * 2 end\n"
+        "local sum = 0\n"
+        "for i = 1, 200000 do sum = sum + outer(i) % 3 end\n";
+
+    constexpr std::chrono::microseconds Intervals[] = {
+        std::chrono::microseconds(1000),
+        std::chrono::microseconds(100),
+    };
+}
+
+// The same script with and without the sampling profiler running, at the default interval and a ten times higher
+// rate. The overhead should stay below a few percent at the default.
+void BenchmarkSamplingProfiler()
+{
+    LuaTypeRegistry<ElementNode> registry("ElementNode");
+    registry.RegisterMethod<&ElementNode::Add>("Add");
+    registry.Finalize();
+
+    LuaManager manager{};
+    manager.ApplyRegistry(registry);
+    static_cast<void>(manager.Instantiate(registry));
+    manager.SetGlobal("node");
+    LuaManager::ChunkHandle chunk = manager.Compile(Script);
+
+    double unprofiled = RunBenchmark("not sampling", LuaIterations, [&manager, chunk]() {
+        manager.Run(chunk);
+    });
+
+    for (std::chrono::microseconds interval : Intervals)
+    {
+        std::string name = "sampling every " + std::to_string(interval.count()) + " us";
+
+        manager.StartSampling(interval);
+        double profiled = RunBenchmark(name, LuaIterations, [&manager, chunk]() {
+            manager.Run(chunk);
+        });
+
+        std::ostringstream stacks;
+        manager.StopSampling(stacks);
+
+        std::printf("  %-56s %12.2f %%\n", (name + ", overhead").c_str(), (profiled / unprofiled - 1.0) * 100.0);
+    }
+}
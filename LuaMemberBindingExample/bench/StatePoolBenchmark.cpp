@@ -0,0 +1,42 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <Benchmark.hpp>
+#include <LuaStatePool.hpp>
+
+namespace
+{
+    constexpr size_t ThreadCounts[] = {1, 2, 4, 8, 16};
+    constexpr size_t JobCount = 256;
+
+    // enough work per job that queueing isn't all that gets measured
+    constexpr const char* JobScript = "local sum = 0 for i = 1, 20000 do sum = sum + i % 7 end";
+}
+
+// Throughput of the pool as the number of workers grows, with every job running the same CPU bound script.
+void BenchmarkStatePool()
+{
+    std::printf("  hardware threads: %u\n", std::thread::hardware_concurrency());
+
+    for (size_t threadCount : ThreadCounts)
+    {
+        LuaStatePool pool(threadCount, [](LuaManager&) {});
+
+        double nanoseconds = RunBenchmark(std::to_string(threadCount) + " threads, per job", JobCount, [&pool]() {
+            for (size_t i = 0; i < JobCount; ++i)
+            {
+                pool.Submit([](LuaManager& manager) {
+                    manager.Execute(JobScript);
+                });
+            }
+
+            pool.Wait();
+        });
+
+        std::printf("  %-56s %12.0f jobs/s\n", (std::to_string(threadCount) + " threads, throughput").c_str(),
+            1e9 / nanoseconds);
+    }
+}
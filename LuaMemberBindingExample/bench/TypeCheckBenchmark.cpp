@@ -0,0 +1,90 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <Benchmark.hpp>
+#include <ElementNode.hpp>
+#include <LuaTypeRegistry.hpp>
+
+namespace
+{
+    constexpr int LuaIterations = 1000000;
+
+    int CallOnly(lua_State*)
+    {
+        return 0;
+    }
+
+    int CheckByName(lua_State* L)
+    {
+        BenchmarkSink = reinterpret_cast<size_t>(luaL_checkudata(L, 1, "ElementNode"));
+        return 0;
+    }
+
+    // what the registry's closures do, against the metatable held in upvalue 1
+    int CheckByIdentity(lua_State* L)
+    {
+        void* value = lua_touserdata(L, 1);
+        if (value == nullptr || !lua_getmetatable(L, 1) || !lua_rawequal(L, -1, lua_upvalueindex(1)))
+        {
+            return luaL_typeerror(L, 1, "ElementNode");
+        }
+
+        lua_pop(L, 1);
+        BenchmarkSink = reinterpret_cast<size_t>(value);
+        return 0;
+    }
+
+    double TimeCalls(lua_State* L, const char* function, const std::string& name)
+    {
+        std::string code = std::string("local f, node = ") + function + ", node for i = 1, "
+            + std::to_string(LuaIterations) + " do f(node) end";
+        if (luaL_loadstring(L, code.c_str()) != LUA_OK)
+        {
+            throw std::runtime_error(lua_tostring(L, -1));
+        }
+
+        int chunk = luaL_ref(L, LUA_REGISTRYINDEX);
+        double nanoseconds = RunBenchmark(name, LuaIterations, [L, chunk]() {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, chunk);
+            if (lua_pcall(L, 0, 0, 0) != LUA_OK)
+            {
+                throw std::runtime_error(lua_tostring(L, -1));
+            }
+        });
+
+        luaL_unref(L, LUA_REGISTRYINDEX, chunk);
+        return nanoseconds;
+    }
+}
+
+// The type check on its own: three C functions that take the node, one doing nothing, one calling luaL_checkudata and
+// one comparing metatable identity like CheckUserdata. The check lines are what each adds to the bare call.
+void BenchmarkTypeCheck()
+{
+    LuaTypeRegistry<ElementNode> registry("ElementNode");
+    registry.RegisterField("PointlessBool", &ElementNode::pointlessBool);
+    registry.Finalize();
+
+    lua_State* L = luaL_newstate();
+    registry.GenerateBindings(L);
+    static_cast<void>(registry.Allocate(L));
+    lua_setglobal(L, "node");
+
+    lua_register(L, "CallOnly", CallOnly);
+    lua_register(L, "CheckByName", CheckByName);
+    luaL_getmetatable(L, "ElementNode");
+    lua_pushcclosure(L, CheckByIdentity, 1);
+    lua_setglobal(L, "CheckByIdentity");
+
+    double call = TimeCalls(L, "CallOnly", "call only");
+    double byName = TimeCalls(L, "CheckByName", "call + luaL_checkudata");
+    double byIdentity = TimeCalls(L, "CheckByIdentity", "call + metatable identity check");
+
+    std::printf("  %-56s %12.2f ns/op\n", "type check, luaL_checkudata", byName - call);
+    std::printf("  %-56s %12.2f ns/op\n", "type check, metatable identity", byIdentity - call);
+
+    lua_close(L);
+}
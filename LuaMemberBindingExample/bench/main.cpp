@@ -0,0 +1,44 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <cstdio>
+#include <string_view>
+#include <Benchmark.hpp>
+
+namespace
+{
+    struct NamedBenchmark
+    {
+        std::string_view name;
+        void (*run)();
+    };
+
+    constexpr NamedBenchmark Benchmarks[] = {
+        {"MemberLookup", BenchmarkMemberLookup},
+        {"IndexMode", BenchmarkIndexMode},
+        {"MethodBinding", BenchmarkMethodBinding},
+        {"TypeCheck", BenchmarkTypeCheck},
+        {"BytecodeCache", BenchmarkBytecodeCache},
+        {"StatePool", BenchmarkStatePool},
+        {"SamplingProfiler", BenchmarkSamplingProfiler},
+    };
+}
+
+// Runs every benchmark, or only the ones named on the command line. Build in release mode before trusting the numbers.
+int main(int argc, char** argv)
+{
+    for (const NamedBenchmark& benchmark : Benchmarks)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc && !selected; ++i)
+        {
+            selected = benchmark.name == argv[i];
+        }
+
+        if (selected)
+        {
+            std::printf("%.*s\n", static_cast<int>(benchmark.name.size()), benchmark.name.data());
+            benchmark.run();
+        }
+    }
+}
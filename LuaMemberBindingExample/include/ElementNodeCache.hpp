@@ -1,13 +1,56 @@
-// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
-// for more information.
-
-
-#ifndef ELEMENTNODECACHE_H
-#define ELEMENTNODECACHE_H
-
-class ElementNodeCache
-{
-
-};
-
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef ELEMENTNODECACHE_H
+#define ELEMENTNODECACHE_H
+
+#include <cstddef>
+#include <ElementNode.hpp>
+#include <memory>
+#include <vector>
+
+// Slab pool of ElementNode storage. Released nodes are destroyed and their slot goes onto a free list, so creating and
+// dropping nodes from Lua reuses memory instead of going to the allocator every time. Use it with
+// LuaTypeRegistry::SetObjectPool; it must outlive every Lua state holding its nodes.
+class ElementNodeCache
+{
+private:
+    union Slot
+    {
+        Slot() noexcept {}
+        ~Slot() noexcept {}
+
+        ElementNode node;
+        Slot* next;
+    };
+
+    static constexpr size_t SlabSize = 256;
+
+    std::vector<std::unique_ptr<Slot[]>> _slabs;
+    Slot* _freeList;
+    size_t _liveCount;
+
+    void AddSlab();
+
+public:
+    ElementNodeCache() noexcept;
+
+    ElementNodeCache(const ElementNodeCache&) = delete;
+    ElementNodeCache& operator=(const ElementNodeCache&) = delete;
+
+    [[nodiscard]] ElementNode* Acquire();
+    void Release(ElementNode* node) noexcept;
+
+    [[nodiscard]] inline size_t GetLiveCount() const noexcept
+    {
+        return _liveCount;
+    }
+
+    [[nodiscard]] inline size_t GetCapacity() const noexcept
+    {
+        return _slabs.size() * SlabSize;
+    }
+};
+
 #endif
\ No newline at end of file
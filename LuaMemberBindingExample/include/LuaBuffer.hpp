@@ -0,0 +1,353 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUABUFFER_HPP
+#define LUABUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <lua.hpp>
+#include <LuaColumnKernels.hpp>
+#include <LuaStack.hpp>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+template <typename TElement>
+struct LuaBufferTraits;
+
+template <>
+struct LuaBufferTraits<int32_t>
+{
+    static constexpr const char* Name = "Int32Buffer";
+};
+
+template <>
+struct LuaBufferTraits<double>
+{
+    static constexpr const char* Name = "Float64Buffer";
+};
+
+// Typed array userdata for moving bulk numeric data between C++ and Lua without building tables. A buffer either owns
+// its elements (they follow the header in the same userdata block) or is a view over memory owned elsewhere: a C++
+// span pushed with PushView, or a slice of another buffer, which it keeps alive through its user value.
+// In Lua, buffers index from 1 like arrays, #buffer is the length and buffer:Slice(first, count) makes a view.
+template <typename TElement>
+class LuaBuffer
+{
+private:
+    struct Header
+    {
+        TElement* data;
+        size_t length;
+    };
+
+    // elements of an owned buffer start right after the header, so keep them aligned
+    static constexpr size_t ElementsOffset = (sizeof(Header) + alignof(TElement) - 1) / alignof(TElement) * alignof(TElement);
+
+    // The metatable lives in the Lua registry under the address of this instead of under the type name, so checking a
+    // buffer is a pointer-keyed lookup rather than a string one. A variable of its own, as identical string literals
+    // aren't guaranteed to share an address.
+    static inline const char MetatableKey = 0;
+
+    // Pushes a userdata with the buffer metatable, or returns nullptr with nothing pushed when the buffer type hasn't
+    // been bound to L. Functions called from Lua raise that as a Lua error through PushHeader, the C++ facing Push and
+    // PushView run outside any protected call and throw instead.
+    static Header* TryPushHeader(lua_State* L, size_t extraSize)
+    {
+        if (lua_rawgetp(L, LUA_REGISTRYINDEX, &MetatableKey) == LUA_TNIL)
+        {
+            lua_pop(L, 1);
+            return nullptr;
+        }
+
+        Header* header = static_cast<Header*>(lua_newuserdatauv(L, ElementsOffset + extraSize, 1));
+        lua_rotate(L, -2, 1);
+        lua_setmetatable(L, -2);
+        return header;
+    }
+
+    static Header* PushHeader(lua_State* L, size_t extraSize)
+    {
+        Header* header = TryPushHeader(L, extraSize);
+        if (header == nullptr)
+        {
+            luaL_error(L, "%s has not been bound to this state", LuaBufferTraits<TElement>::Name);
+        }
+
+        return header;
+    }
+
+    [[nodiscard]] static bool FitsLength(size_t length) noexcept
+    {
+        return length <= (SIZE_MAX - ElementsOffset) / sizeof(TElement);
+    }
+
+    static std::span<TElement> ConstructElements(Header* header, size_t length) noexcept
+    {
+        header->data = reinterpret_cast<TElement*>(reinterpret_cast<std::byte*>(header) + ElementsOffset);
+        header->length = length;
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            new (header->data + i) TElement();
+        }
+
+        return std::span<TElement>(header->data, length);
+    }
+
+    // Push for functions called from Lua
+    static std::span<TElement> PushOwned(lua_State* L, size_t length)
+    {
+        if (!FitsLength(length))
+        {
+            luaL_error(L, "%s is too large", LuaBufferTraits<TElement>::Name);
+        }
+
+        return ConstructElements(PushHeader(L, length * sizeof(TElement)), length);
+    }
+
+    [[noreturn]] static void ThrowNotBound()
+    {
+        throw std::runtime_error(std::string(LuaBufferTraits<TElement>::Name) + " has not been bound to this state.");
+    }
+
+    static size_t CheckIndex(lua_State* L, const Header* header, int index)
+    {
+        lua_Integer position = luaL_checkinteger(L, index);
+        if (position < 1 || static_cast<size_t>(position) > header->length)
+        {
+            luaL_error(L, "index %I out of range for %s of length %I", position,
+                LuaBufferTraits<TElement>::Name, static_cast<lua_Integer>(header->length));
+        }
+
+        return static_cast<size_t>(position - 1);
+    }
+
+    static Header* CheckHeader(lua_State* L, int index)
+    {
+        void* value = lua_touserdata(L, index);
+        if (value != nullptr && lua_getmetatable(L, index))
+        {
+            lua_rawgetp(L, LUA_REGISTRYINDEX, &MetatableKey);
+            bool matches = lua_rawequal(L, -1, -2);
+            lua_pop(L, 2);
+
+            if (matches)
+            {
+                return static_cast<Header*>(value);
+            }
+        }
+
+        luaL_typeerror(L, index, LuaBufferTraits<TElement>::Name);
+        return nullptr;
+    }
+
+    static int Index(lua_State* L)
+    {
+        Header* header = CheckHeader(L, 1);
+        if (lua_type(L, 2) == LUA_TNUMBER)
+        {
+            LuaStack<TElement>::Push(L, header->data[CheckIndex(L, header, 2)]);
+            return 1;
+        }
+
+        // anything else is a method, held in the first upvalue
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
+    static int NewIndex(lua_State* L)
+    {
+        Header* header = CheckHeader(L, 1);
+        header->data[CheckIndex(L, header, 2)] = LuaStack<TElement>::Check(L, 3);
+        return 0;
+    }
+
+    static int Length(lua_State* L)
+    {
+        lua_pushinteger(L, static_cast<lua_Integer>(CheckHeader(L, 1)->length));
+        return 1;
+    }
+
+    static int Slice(lua_State* L)
+    {
+        Header* parent = CheckHeader(L, 1);
+        lua_Integer first = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, first >= 1 && static_cast<size_t>(first) <= parent->length + 1, 2, "slice start out of range");
+
+        // the rest of the buffer by default, worked out only once first is known to be in range
+        size_t remaining = parent->length - static_cast<size_t>(first - 1);
+        lua_Integer count = luaL_optinteger(L, 3, static_cast<lua_Integer>(remaining));
+        luaL_argcheck(L, count >= 0 && static_cast<size_t>(count) <= remaining, 3, "slice length out of range");
+
+        Header* header = PushHeader(L, 0);
+        header->data = parent->data + (first - 1);
+        header->length = static_cast<size_t>(count);
+
+        // the slice keeps whatever owns the elements alive
+        lua_pushvalue(L, 1);
+        lua_setiuservalue(L, -2, 1);
+        return 1;
+    }
+
+    static int Create(lua_State* L)
+    {
+        lua_Integer length = luaL_checkinteger(L, 1);
+        luaL_argcheck(L, length >= 0, 1, "buffer length must not be negative");
+
+        static_cast<void>(PushOwned(L, static_cast<size_t>(length)));
+        return 1;
+    }
+
+    static bool PartiallyOverlaps(std::span<const TElement> lhs, std::span<const TElement> rhs) noexcept
+    {
+        std::less<const TElement*> before;
+        return lhs.data() != rhs.data()
+            && before(lhs.data(), rhs.data() + rhs.size()) && before(rhs.data(), lhs.data() + lhs.size());
+    }
+
+    // Int32Buffer.Add(lhs, rhs[, result]): element-wise sum with wrapping overflow, written into result or into a new
+    // buffer, which is returned. result may be lhs or rhs itself but must not partly overlap either of them.
+    static int Add(lua_State* L)
+    {
+        std::span<const TElement> lhs = Check(L, 1);
+        std::span<const TElement> rhs = Check(L, 2);
+        luaL_argcheck(L, lhs.size() == rhs.size(), 2, "buffer lengths differ");
+
+        std::span<TElement> result;
+        if (lua_isnoneornil(L, 3))
+        {
+            result = PushOwned(L, lhs.size());
+        }
+        else
+        {
+            result = Check(L, 3);
+            luaL_argcheck(L, result.size() == lhs.size(), 3, "buffer lengths differ");
+            luaL_argcheck(L, !PartiallyOverlaps(result, lhs) && !PartiallyOverlaps(result, rhs), 3,
+                "buffer partly overlaps an operand");
+            lua_settop(L, 3);
+        }
+
+        LuaColumnAdd(lhs, rhs, result);
+        return 1;
+    }
+
+public:
+    // Registers the buffer metatable and a global table holding New(length), and Add for Int32Buffer.
+    static void GenerateBindings(lua_State* L)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &MetatableKey);
+        bool exists = !lua_isnil(L, -1);
+        lua_pop(L, 1);
+
+        if (exists)
+        {
+            throw std::runtime_error("This Lua buffer type already exists");
+        }
+
+        lua_createtable(L, 0, 4);
+
+        lua_pushliteral(L, "__index");
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "Slice");
+        lua_pushcfunction(L, Slice);
+        lua_rawset(L, -3);
+        lua_pushcclosure(L, Index, 1);
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "__newindex");
+        lua_pushcfunction(L, NewIndex);
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "__len");
+        lua_pushcfunction(L, Length);
+        lua_rawset(L, -3);
+
+        lua_pushliteral(L, "__name");
+        lua_pushstring(L, LuaBufferTraits<TElement>::Name);
+        lua_rawset(L, -3);
+
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &MetatableKey);
+
+        lua_createtable(L, 0, 2);
+        lua_pushliteral(L, "New");
+        lua_pushcfunction(L, Create);
+        lua_rawset(L, -3);
+
+        if constexpr (std::is_same_v<TElement, int32_t>)
+        {
+            lua_pushliteral(L, "Add");
+            lua_pushcfunction(L, Add);
+            lua_rawset(L, -3);
+        }
+
+        lua_setglobal(L, LuaBufferTraits<TElement>::Name);
+    }
+
+    // Pushes a new zero-initialised buffer that owns its elements and returns them for filling in. Throws if the
+    // buffer type isn't bound to L or length is too large.
+    static std::span<TElement> Push(lua_State* L, size_t length)
+    {
+        if (!FitsLength(length))
+        {
+            throw std::runtime_error(std::string(LuaBufferTraits<TElement>::Name) + " is too large.");
+        }
+
+        Header* header = TryPushHeader(L, length * sizeof(TElement));
+        if (header == nullptr)
+        {
+            ThrowNotBound();
+        }
+
+        return ConstructElements(header, length);
+    }
+
+    // Pushes a buffer viewing memory owned by C++, nothing is copied. The memory must outlive every use of the
+    // buffer, including slices of it, from Lua. Throws if the buffer type isn't bound to L.
+    static void PushView(lua_State* L, std::span<TElement> elements)
+    {
+        Header* header = TryPushHeader(L, 0);
+        if (header == nullptr)
+        {
+            ThrowNotBound();
+        }
+
+        header->data = elements.data();
+        header->length = elements.size();
+    }
+
+    // The elements of the buffer at index, valid for as long as that buffer is.
+    static std::span<TElement> Check(lua_State* L, int index)
+    {
+        Header* header = CheckHeader(L, index);
+        return std::span<TElement>(header->data, header->length);
+    }
+};
+
+// Lets bound methods take and return buffers as spans. Returned spans are pushed as views, so they must point at
+// memory that outlives the buffer in Lua. Buffers are always writable from Lua, so const spans can be taken but not
+// returned.
+template <typename TElement>
+struct LuaStack<std::span<TElement>>
+{
+    using BufferType = LuaBuffer<std::remove_const_t<TElement>>;
+
+    static void Push(lua_State* L, std::span<TElement> value)
+    {
+        static_assert(!std::is_const_v<TElement>, "Lua buffers are writable, so a span of const elements cannot be pushed.");
+        BufferType::PushView(L, value);
+    }
+
+    static std::span<TElement> Check(lua_State* L, int index)
+    {
+        return BufferType::Check(L, index);
+    }
+};
+
+#endif
\ No newline at end of file
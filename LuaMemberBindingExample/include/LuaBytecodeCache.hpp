@@ -0,0 +1,48 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUABYTECODECACHE_HPP
+#define LUABYTECODECACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <lua.hpp>
+#include <string_view>
+
+// On-disk cache of compiled chunks. Entries are named after a hash of their source and keep a copy of the source, and
+// are only used when the source and the Lua version both match, otherwise the source is compiled and the entry
+// rewritten. The hash only picks the file, so a collision costs a compile rather than running the wrong chunk.
+//
+// Several states, threads or processes can share a directory: every writer stages its entry in a file of its own
+// before renaming it into place.
+class LuaBytecodeCache
+{
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t luaVersion;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+    };
+
+    std::filesystem::path _directory;
+
+    [[nodiscard]] static Header MakeHeader(std::string_view source) noexcept;
+    [[nodiscard]] std::filesystem::path GetEntryPath(const Header& header) const;
+    bool TryLoadEntry(lua_State* L, const std::filesystem::path& path, const Header& expected, std::string_view source,
+        const char* chunkName) const;
+    void StoreEntry(lua_State* L, const std::filesystem::path& path, const Header& header, std::string_view source) const;
+
+public:
+    explicit LuaBytecodeCache(std::filesystem::path directory);
+
+    // Pushes the compiled chunk for source onto the stack, exactly like luaL_loadbuffer, and returns its status code.
+    int Load(lua_State* L, std::string_view source, const char* chunkName) const;
+
+    // 64-bit FNV-1a. std::hash is not guaranteed to be stable between runs, which an on-disk key needs.
+    [[nodiscard]] static uint64_t HashSource(std::string_view source) noexcept;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUACOLUMNKERNELS_HPP
+#define LUACOLUMNKERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Bulk kernels over packed columns, such as the ones LuaColumnStore::GetColumn hands out. They use AVX2 when the
+// compiler targets it (-mavx2, /arch:AVX2, which the LUA_MEMBER_BINDING_AVX2 CMake option turns on), SSE2 on any other
+// x86-64 build and plain loops everywhere else.
+
+[[nodiscard]] size_t LuaColumnCountEqual(std::span<const bool> column, bool value) noexcept;
+[[nodiscard]] size_t LuaColumnCountEqual(std::span<const int32_t> column, int32_t value) noexcept;
+
+void LuaColumnFill(std::span<bool> column, bool value) noexcept;
+void LuaColumnFill(std::span<int32_t> column, int32_t value) noexcept;
+
+// result[i] = lhs[i] + rhs[i] with wrapping overflow, over the shortest of the three spans
+void LuaColumnAdd(std::span<const int32_t> lhs, std::span<const int32_t> rhs, std::span<int32_t> result) noexcept;
+
+#endif
\ No newline at end of file
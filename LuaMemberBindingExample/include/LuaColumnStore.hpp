@@ -0,0 +1,149 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUACOLUMNSTORE_HPP
+#define LUACOLUMNSTORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Type-erased operations on one field type, enough to keep values of it in a column.
+struct LuaFieldType
+{
+    size_t size;
+    size_t alignment;
+    void (*construct)(void* destination);
+    void (*moveConstruct)(void* destination, void* source);
+    void (*moveAssign)(void* destination, void* source);
+    void (*copyAssign)(void* destination, const void* source);
+    void (*destroy)(void* value);
+};
+
+template <typename TMember>
+inline constexpr LuaFieldType LuaFieldTypeOf
+{
+    sizeof(TMember),
+    alignof(TMember),
+    [](void* destination) { new (destination) TMember(); },
+    [](void* destination, void* source) { new (destination) TMember(std::move(*static_cast<TMember*>(source))); },
+    [](void* destination, void* source) { *static_cast<TMember*>(destination) = std::move(*static_cast<TMember*>(source)); },
+    [](void* destination, const void* source) { *static_cast<TMember*>(destination) = *static_cast<const TMember*>(source); },
+    [](void* value) { static_cast<TMember*>(value)->~TMember(); }
+};
+
+// Byte offset of a data member. There's no offsetof for a pointer to member, so measure it against storage that never
+// gets constructed. Only addresses are taken here, nothing is read.
+template <typename T, typename TMember>
+size_t LuaGetMemberOffset(TMember T::* member) noexcept
+{
+    union Probe
+    {
+        Probe() noexcept {}
+        ~Probe() noexcept {}
+
+        T object;
+    } probe;
+
+    return static_cast<size_t>(
+        reinterpret_cast<const std::byte*>(&(probe.object.*member)) - reinterpret_cast<const std::byte*>(&probe));
+}
+
+// Structure-of-arrays storage for the instances of one registered type, used through
+// LuaTypeRegistry::SetColumnStore. Every registered field gets its own contiguous column and Lua userdata only hold
+// the row's id. Rows are kept densely packed (destroying one moves the last row into its place), so a column is
+// always exactly GetSize() live values long and can be swept directly from C++.
+class LuaColumnStore
+{
+public:
+    using Id = uint32_t;
+
+private:
+    struct Column
+    {
+        size_t offset;
+        const LuaFieldType* type;
+        std::byte* data;
+    };
+
+    static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+    std::vector<Column> _columns;
+    std::vector<uint32_t> _rowOfId;
+    std::vector<Id> _idOfRow;
+    std::vector<Id> _freeIds;
+    size_t _size;
+    size_t _capacity;
+
+    void Grow();
+
+    [[nodiscard]] const Column* FindColumn(size_t offset) const noexcept;
+
+    [[nodiscard]] static inline std::byte* GetElement(const Column& column, size_t row) noexcept
+    {
+        return column.data + row * column.type->size;
+    }
+
+public:
+    LuaColumnStore() noexcept;
+    ~LuaColumnStore();
+
+    LuaColumnStore(const LuaColumnStore&) = delete;
+    LuaColumnStore& operator=(const LuaColumnStore&) = delete;
+
+    // Called by the registry when it is finalized, once per field. Columns can't be added once rows exist.
+    void AddColumn(size_t offset, const LuaFieldType& type);
+
+    [[nodiscard]] Id Create();
+    void Destroy(Id id) noexcept;
+
+    [[nodiscard]] inline size_t GetSize() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] inline size_t GetColumnCount() const noexcept
+    {
+        return _columns.size();
+    }
+
+    [[nodiscard]] inline size_t GetRow(Id id) const noexcept
+    {
+        return _rowOfId[id];
+    }
+
+    [[nodiscard]] inline Id GetId(size_t row) const noexcept
+    {
+        return _idOfRow[row];
+    }
+
+    // Address of the value of the field at offset for the given row, or nullptr if no such column exists.
+    [[nodiscard]] void* GetFieldAddress(Id id, size_t offset) const noexcept;
+
+    // Start of the column for the field at offset, or nullptr if there's no such column or it holds another type.
+    [[nodiscard]] void* GetColumnData(size_t offset, const LuaFieldType& type) const noexcept;
+
+    // Copies every column that fits inside an object of objectSize bytes into object, or back out of it.
+    void Gather(Id id, void* object, size_t objectSize) const;
+    void Scatter(Id id, const void* object, size_t objectSize);
+
+    // The packed values of one field across all live rows, indexed by row.
+    template <typename T, typename TMember>
+    [[nodiscard]] std::span<TMember> GetColumn(TMember T::* member)
+    {
+        const Column* column = FindColumn(LuaGetMemberOffset(member));
+        if (column == nullptr || column->type != &LuaFieldTypeOf<TMember>)
+        {
+            throw std::runtime_error("The column store has no column for this member.");
+        }
+
+        return std::span<TMember>(reinterpret_cast<TMember*>(column->data), _size);
+    }
+};
+
+#endif
\ No newline at end of file
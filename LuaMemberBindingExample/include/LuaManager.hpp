@@ -1,40 +1,226 @@
-// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
-// for more information.
-
-
-#ifndef LUAMANAGER_H
-#define LUAMANAGER_H
-
-#include <lua.hpp>
-#include <typeinfo>
-#include <map>
-#include <LuaTypeRegistry.hpp>
-
-class LuaManager
-{
-private:
-    lua_State* L;
-
-public:
-    LuaManager();
-    ~LuaManager();
-
-    template<typename T>
-    void ApplyRegistry(const LuaTypeRegistry<T>& typeRegistry)
-    {
-        typeRegistry.GenerateBindings(L);
-    }
-
-    template<typename T>
-    T* Instantiate(LuaTypeRegistry<T>& typeRegistry)
-    {
-        return typeRegistry.Allocate(L);
-    }
-
-    void Execute(std::string code);
-    void SetGlobal(std::string name);
-
-    void SetGlobalFunction(std::string name, lua_CFunction fn);
-};
-
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUAMANAGER_H
+#define LUAMANAGER_H
+
+#include <filesystem>
+#include <chrono>
+#include <list>
+#include <lua.hpp>
+#include <typeinfo>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <LuaBuffer.hpp>
+#include <LuaBytecodeCache.hpp>
+#include <LuaPoolAllocator.hpp>
+#include <LuaSamplingProfiler.hpp>
+#include <LuaScheduler.hpp>
+#include <LuaTypeRegistry.hpp>
+
+enum class LuaGcMode
+{
+    Incremental,
+    Generational
+};
+
+// Collector work done through LuaManager's Step and Collect. Collections the collector runs on its own while it is
+// running automatically are not seen here, except by finalizedObjects.
+struct LuaGcTelemetry
+{
+    size_t stepCount;
+    size_t cycleCount;
+    std::chrono::nanoseconds stepTime;
+    // time spent in the steps of the last completed cycle
+    std::chrono::nanoseconds lastCycleTime;
+    size_t bytesFreed;
+    // objects of types bound through a LuaTypeRegistry finalized in any collection, however it was started; other
+    // userdata and tables with a __gc of their own are not counted
+    size_t finalizedObjects;
+};
+
+class LuaManager
+{
+public:
+    // A compiled chunk, stored as a reference into the Lua registry of the state that compiled it.
+    using ChunkHandle = int;
+
+private:
+    struct SourceHash
+    {
+        using is_transparent = void;
+
+        [[nodiscard]] size_t operator()(std::string_view source) const noexcept
+        {
+            return std::hash<std::string_view>{}(source);
+        }
+    };
+
+    static constexpr size_t DefaultExecuteCacheCapacity = 64;
+
+    struct ExecutedChunk
+    {
+        std::string source;
+        ChunkHandle chunk;
+    };
+
+    lua_State* L;
+
+    // Chunks made by Compile, kept until they are released, and the source of each for Release to find them by.
+    std::unordered_map<std::string, ChunkHandle, SourceHash, std::equal_to<>> _compiledChunks;
+    std::unordered_map<ChunkHandle, std::string_view> _compiledSources;
+
+    // Chunks compiled implicitly by Execute and Spawn, most recently used first. Scripts are often built at runtime,
+    // so only the last _executeCacheCapacity of them are kept.
+    std::list<ExecutedChunk> _executedChunks;
+    std::unordered_map<std::string_view, std::list<ExecutedChunk>::iterator> _executedIndex;
+    size_t _executeCacheCapacity;
+
+    std::optional<LuaBytecodeCache> _bytecodeCache;
+    std::unique_ptr<LuaScheduler> _scheduler;
+    std::unique_ptr<LuaSamplingProfiler> _samplingProfiler;
+    LuaGcTelemetry _gcTelemetry;
+    std::chrono::nanoseconds _currentCycleTime;
+
+    // as last set through this class, Lua has no way to ask for it without switching modes
+    LuaGcMode _gcMode;
+
+    void InstallGcTelemetry();
+
+    // Compiles code into a new function and returns a reference to it, without looking at any cache.
+    [[nodiscard]] ChunkHandle Load(std::string_view code);
+
+    // Pushes the function Execute and Spawn run for code: the Compile one if code was compiled explicitly, otherwise
+    // one from the execute cache, or a new one that isn't kept at all if the cache is turned off.
+    void PushExecutedChunk(std::string_view code);
+    void EvictExecutedChunks(size_t keep);
+
+    // Calls the function on top of the stack, turning a Lua error into a std::runtime_error.
+    void CallChunk();
+
+    static int Panic(lua_State* L);
+
+    // luaL_newstate's warning function, which lauxlib keeps to itself: warnings start off, "@on" and "@off" switch
+    // them, and every message goes to stderr prefixed with "Lua warning: ".
+    static bool HandleWarningControl(lua_State* L, const char* message, int toContinue);
+    static void WarnOff(void* userData, const char* message, int toContinue);
+    static void WarnOn(void* userData, const char* message, int toContinue);
+    static void WarnContinue(void* userData, const char* message, int toContinue);
+
+public:
+    LuaManager();
+
+    // Creates the state with a custom allocator instead of the system malloc. userData is passed to every call and,
+    // like the allocator itself, must outlive the manager.
+    LuaManager(lua_Alloc allocator, void* userData);
+    explicit LuaManager(LuaPoolAllocator& allocator);
+    ~LuaManager();
+
+    template<typename T, typename TProfiler>
+    void ApplyRegistry(const LuaTypeRegistry<T, TProfiler>& typeRegistry, LuaIndexMode mode = LuaIndexMode::Dispatch)
+    {
+        typeRegistry.GenerateBindings(L, mode);
+    }
+
+    template<typename T, typename TProfiler>
+    T* Instantiate(const LuaTypeRegistry<T, TProfiler>& typeRegistry)
+    {
+        return typeRegistry.Allocate(L);
+    }
+
+    // Pushes a non-owning reference to a tracked C++ object, ready for SetGlobal.
+    template<typename T, typename TProfiler>
+    void InstantiateReference(const LuaTypeRegistry<T, TProfiler>& typeRegistry, LuaObjectTracker& tracker,
+        LuaObjectTracker::Handle handle)
+    {
+        typeRegistry.PushReference(L, tracker, handle);
+    }
+
+    template<typename TElement>
+    void ApplyBufferType()
+    {
+        LuaBuffer<TElement>::GenerateBindings(L);
+    }
+
+    // Pushes a new buffer owning length zeroed elements, ready for SetGlobal, and returns the elements for filling in.
+    template<typename TElement>
+    std::span<TElement> AllocateBuffer(size_t length)
+    {
+        return LuaBuffer<TElement>::Push(L, length);
+    }
+
+    // Pushes a buffer over memory owned by C++ without copying it, ready for SetGlobal. The memory must outlive the
+    // state or every reference to the buffer in Lua.
+    template<typename TElement>
+    void InstantiateBufferView(std::span<TElement> elements)
+    {
+        LuaBuffer<TElement>::PushView(L, elements);
+    }
+
+    // Compiled chunks are dumped into directory and loaded back from there on later runs instead of being compiled
+    // from source again.
+    void EnableBytecodeCache(std::filesystem::path directory);
+
+    // Compiles code once per state; compiling the same source again returns the cached chunk. The chunk is kept until
+    // it is released.
+    [[nodiscard]] ChunkHandle Compile(std::string_view code);
+    void Run(ChunkHandle chunk);
+
+    // Frees a chunk returned by Compile. The handle must not be used afterwards.
+    void Release(ChunkHandle chunk);
+
+    // Runs code, compiling it only if it isn't among the most recently executed scripts, see SetExecuteCacheCapacity.
+    void Execute(std::string_view code);
+
+    // How many scripts Execute and Spawn keep compiled, 64 by default. The least recently used one is released once
+    // the cache is full, and 0 turns caching off.
+    void SetExecuteCacheCapacity(size_t capacity);
+
+    // Starts code as a task on this state's scheduler instead of running it to completion. Drive it with
+    // GetScheduler().Update() or RunUntilIdle().
+    LuaScheduler::TaskId Spawn(std::string_view code);
+
+    // The scheduler is created on first use.
+    [[nodiscard]] LuaScheduler& GetScheduler();
+    // 0 keeps a parameter's current value, see the Lua manual for their meaning.
+    void SetGcMode(LuaGcMode mode);
+    void SetIncrementalGcParameters(int pause, int stepMultiplier, int stepSize = 0);
+    void SetGenerationalGcParameters(int minorMultiplier, int majorMultiplier);
+
+    // Stopping the automatic collector leaves all collection to Step and Collect, so it only happens when they are
+    // called, for example in idle time between frames or requests.
+    void SetGcRunning(bool running);
+    [[nodiscard]] bool IsGcRunning() const;
+
+    // Does incremental collection steps until budget runs out or a cycle completes, whichever is first, and returns
+    // whether a cycle completed. A step can overrun the budget by its own length. In generational mode a step is a
+    // whole minor or major collection, so exactly one is done and counted as a cycle whatever the budget. The mode is
+    // the one last set with SetGcMode or the parameter setters; collectgarbage calls from scripts aren't seen.
+    bool Step(std::chrono::microseconds budget);
+    void Collect();
+
+    [[nodiscard]] size_t GetMemoryUsage() const;
+    [[nodiscard]] inline const LuaGcTelemetry& GetGcTelemetry() const noexcept
+    {
+        return _gcTelemetry;
+    }
+
+    // Samples the Lua call stack once per interval until StopSampling, see LuaSamplingProfiler.
+    void StartSampling(std::chrono::microseconds interval = std::chrono::milliseconds(1));
+
+    // Stops sampling and writes the samples to collapsedStacks, ready for a flame graph.
+    void StopSampling(std::ostream& collapsedStacks);
+
+    void SetGlobal(std::string name);
+
+    void SetGlobalFunction(std::string name, lua_CFunction fn);
+};
+
 #endif
\ No newline at end of file
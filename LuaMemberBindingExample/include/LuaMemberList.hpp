@@ -0,0 +1,247 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUAMEMBERLIST_HPP
+#define LUAMEMBERLIST_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// A string literal usable as a template argument, so member names can be part of a type.
+template <size_t N>
+struct LuaFixedString
+{
+    char value[N];
+
+    constexpr LuaFixedString(const char (&text)[N]) noexcept
+    {
+        std::copy_n(text, N, value);
+    }
+
+    [[nodiscard]] constexpr std::string_view View() const noexcept
+    {
+        return std::string_view(value, N - 1);
+    }
+};
+
+template <LuaFixedString TName, typename TPointer>
+struct LuaFieldEntry
+{
+    static constexpr std::string_view Name = TName.View();
+    static constexpr bool IsField = true;
+
+    TPointer pointer;
+};
+
+template <LuaFixedString TName, typename TPointer>
+struct LuaMethodEntry
+{
+    static constexpr std::string_view Name = TName.View();
+    static constexpr bool IsField = false;
+
+    TPointer pointer;
+};
+
+template <LuaFixedString TName, typename TClass, typename TMember>
+[[nodiscard]] constexpr LuaFieldEntry<TName, TMember TClass::*> LuaField(TMember TClass::* member) noexcept
+{
+    return {member};
+}
+
+template <LuaFixedString TName, typename TMethod>
+    requires std::is_member_function_pointer_v<TMethod>
+[[nodiscard]] constexpr LuaMethodEntry<TName, TMethod> LuaMethod(TMethod method) noexcept
+{
+    return {method};
+}
+
+// How LuaHashMemberName is set up for one member list. A sampled hash only looks at the length and the first, middle
+// and last characters, which is all most member sets need to tell their names apart; otherwise every character is
+// hashed.
+struct LuaPerfectHashParameters
+{
+    uint32_t seed;
+    uint32_t mask;
+    bool sampled;
+    bool found;
+};
+
+[[nodiscard]] constexpr uint32_t LuaHashMemberName(std::string_view name, uint32_t seed, bool sampled) noexcept
+{
+    uint32_t hash = (2166136261u ^ seed) ^ static_cast<uint32_t>(name.size());
+    auto mix = [&hash](char character) {
+        hash = (hash ^ static_cast<unsigned char>(character)) * 16777619u;
+    };
+
+    if (sampled)
+    {
+        if (!name.empty())
+        {
+            mix(name.front());
+            mix(name[name.size() / 2]);
+            mix(name.back());
+        }
+    }
+    else
+    {
+        for (char character : name)
+        {
+            mix(character);
+        }
+    }
+
+    // FNV leaves the low bits weak, and only those are used
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+    return hash;
+}
+
+// Searches for a seed and table size under which no two names hash to the same slot. Run at compile time only.
+template <size_t N>
+[[nodiscard]] constexpr LuaPerfectHashParameters LuaFindPerfectHash(const std::array<std::string_view, N>& names) noexcept
+{
+    constexpr uint32_t MaximumSeed = 4096;
+
+    auto sampleDistinct = [&names]() {
+        for (size_t i = 0; i < N; ++i)
+        {
+            for (size_t j = i + 1; j < N; ++j)
+            {
+                const std::string_view& a = names[i];
+                const std::string_view& b = names[j];
+                if (a.size() == b.size()
+                    && (a.empty() || (a.front() == b.front() && a[a.size() / 2] == b[b.size() / 2] && a.back() == b.back())))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    };
+
+    for (bool sampled : {true, false})
+    {
+        if (sampled && !sampleDistinct())
+        {
+            continue;
+        }
+
+        uint32_t smallest = std::bit_ceil(static_cast<uint32_t>(std::max<size_t>(N, 1)));
+        for (uint32_t size = smallest; size <= smallest * 16; size *= 2)
+        {
+            for (uint32_t seed = 0; seed < MaximumSeed; ++seed)
+            {
+                std::array<uint32_t, N> slots{};
+                for (size_t i = 0; i < N; ++i)
+                {
+                    slots[i] = LuaHashMemberName(names[i], seed, sampled) & (size - 1);
+                }
+
+                bool collides = false;
+                for (size_t i = 0; i < N && !collides; ++i)
+                {
+                    for (size_t j = i + 1; j < N && !collides; ++j)
+                    {
+                        collides = slots[i] == slots[j];
+                    }
+                }
+
+                if (!collides)
+                {
+                    return LuaPerfectHashParameters{seed, size - 1, sampled, true};
+                }
+            }
+        }
+    }
+
+    return LuaPerfectHashParameters{0, 0, false, false};
+}
+
+template <size_t N>
+[[nodiscard]] constexpr bool LuaHasUniqueNames(const std::array<std::string_view, N>& names) noexcept
+{
+    for (size_t i = 0; i < N; ++i)
+    {
+        for (size_t j = i + 1; j < N; ++j)
+        {
+            if (names[i] == names[j])
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// A set of members whose names are all known at compile time, built with LuaMembers and registered through
+// LuaTypeRegistry::RegisterMembers. Find resolves a name through a perfect hash worked out by the compiler: one hash
+// of a few characters, a comparison of the slot against a constant per member, which compilers turn into a jump table
+// or a short search, and a single string comparison to reject names that aren't members.
+template <typename... TEntries>
+class LuaMemberList
+{
+public:
+    static constexpr size_t Count = sizeof...(TEntries);
+    static constexpr std::array<std::string_view, Count> Names{TEntries::Name...};
+
+    static_assert(Count > 0, "A member list needs at least one member.");
+    static_assert(LuaHasUniqueNames(Names), "A member list cannot have duplicate member names.");
+
+private:
+    static constexpr LuaPerfectHashParameters Hash = LuaFindPerfectHash(Names);
+    static_assert(Hash.found, "No perfect hash was found for the member names.");
+
+    static constexpr std::array<uint32_t, Count> Slots = []() {
+        std::array<uint32_t, Count> slots{};
+        for (size_t i = 0; i < Count; ++i)
+        {
+            slots[i] = LuaHashMemberName(Names[i], Hash.seed, Hash.sampled) & Hash.mask;
+        }
+
+        return slots;
+    }();
+
+    template <size_t... I>
+    [[nodiscard]] static int FindSlot(uint32_t slot, std::index_sequence<I...>) noexcept
+    {
+        int index = -1;
+        static_cast<void>(((slot == Slots[I] ? (index = static_cast<int>(I), true) : false) || ...));
+        return index;
+    }
+
+public:
+    std::tuple<TEntries...> entries;
+
+    // The position of the member called name in the list, or -1 if there is none.
+    [[nodiscard]] static int Find(std::string_view name) noexcept
+    {
+        int index = FindSlot(LuaHashMemberName(name, Hash.seed, Hash.sampled) & Hash.mask, std::index_sequence_for<TEntries...>{});
+        if (index < 0 || Names[index] != name)
+        {
+            return -1;
+        }
+
+        return index;
+    }
+};
+
+// e.g. static constexpr auto members = LuaMembers(LuaField<"PointlessBool">(&ElementNode::pointlessBool),
+//     LuaMethod<"Add">(&ElementNode::Add));
+template <typename... TEntries>
+[[nodiscard]] constexpr LuaMemberList<TEntries...> LuaMembers(TEntries... entries) noexcept
+{
+    return LuaMemberList<TEntries...>{std::tuple<TEntries...>(entries...)};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUAMEMBERPROFILER_HPP
+#define LUAMEMBERPROFILER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <lua.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The binding entry points a profiler can time.
+enum class LuaProfiledEvent
+{
+    // reading a member through __index, a field get or a method lookup
+    Index,
+    // writing a field through __newindex
+    NewIndex,
+    FreeFunction,
+    Create
+};
+
+// Default profiling policy of LuaTypeRegistry. Every use is behind `if constexpr (TProfiler::Enabled)`, so with this
+// policy the bindings compile to exactly what they would be without any profiling support.
+struct LuaNullProfiler
+{
+    static constexpr bool Enabled = false;
+};
+
+// Profiling policy recording, per bound member and entry point, the call count, the total and approximate percentile
+// latency and the number of allocations made by the call. Allocations are only counted in states using a
+// LuaPoolAllocator, whose statistics are read before and after each call.
+//
+// Entries are created when the registry is finalized, after which recording is lock-free, so a registry shared
+// between states on several threads collects the calls of all of them. Calls that end in a Lua error unwind past
+// Timer::Stop and are not recorded.
+class LuaMemberProfiler
+{
+public:
+    static constexpr bool Enabled = true;
+
+    struct Statistics
+    {
+        // bucket i counts calls that took less than 2^i nanoseconds (and at least 2^(i-1))
+        static constexpr size_t BucketCount = 65;
+
+        std::atomic<uint64_t> callCount{0};
+        std::atomic<uint64_t> totalNanoseconds{0};
+        std::atomic<uint64_t> allocationCount{0};
+        std::array<std::atomic<uint64_t>, BucketCount> histogram{};
+    };
+
+    struct Entry
+    {
+        LuaProfiledEvent event;
+        std::string name;
+        uint64_t callCount;
+        uint64_t totalNanoseconds;
+        // upper bounds of the histogram buckets the percentiles fall in, so accurate to within a factor of two
+        uint64_t p50Nanoseconds;
+        uint64_t p90Nanoseconds;
+        uint64_t p99Nanoseconds;
+        uint64_t allocationCount;
+    };
+
+    // Times a call from construction until Stop, which records it. A null statistics pointer records nothing.
+    // Recording is explicit rather than done by a destructor, since a Lua error longjmps out of the call: whether that
+    // runs destructors depends on the compiler, and either way a failed call shouldn't be recorded as a finished one.
+    class Timer
+    {
+    private:
+        Statistics* _statistics;
+        const void* _allocator;
+        size_t _allocationsBefore;
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+        Timer(Statistics* statistics, lua_State* L) noexcept;
+
+        void Stop() const noexcept;
+    };
+
+private:
+    struct NameHash
+    {
+        using is_transparent = void;
+
+        [[nodiscard]] size_t operator()(std::string_view name) const noexcept
+        {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
+    static constexpr size_t EventCount = 4;
+
+    std::array<std::unordered_map<std::string, std::unique_ptr<Statistics>, NameHash, std::equal_to<>>, EventCount> _statistics;
+
+public:
+    LuaMemberProfiler() noexcept = default;
+
+    LuaMemberProfiler(const LuaMemberProfiler&) = delete;
+    LuaMemberProfiler& operator=(const LuaMemberProfiler&) = delete;
+
+    // Adds an entry. Only called while the registry is being finalized, before anything can record into it.
+    void Register(LuaProfiledEvent event, std::string_view name);
+
+    [[nodiscard]] Statistics* Find(LuaProfiledEvent event, std::string_view name) const noexcept;
+
+    // Every entry that was called at least once, slowest in total first.
+    [[nodiscard]] std::vector<Entry> GetReport() const;
+    void Reset() const noexcept;
+
+    // Pushes GetReport as an array of tables with Event, Name, Calls, TotalNanoseconds, P50Nanoseconds,
+    // P90Nanoseconds, P99Nanoseconds and Allocations fields.
+    void PushReport(lua_State* L) const;
+};
+
+#endif
\ No newline at end of file
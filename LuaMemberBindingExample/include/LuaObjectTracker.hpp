@@ -0,0 +1,101 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUAOBJECTTRACKER_HPP
+#define LUAOBJECTTRACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Generation counted handles for objects that C++ owns but Lua may refer to, see LuaTypeRegistry::PushReference.
+// Lua only ever holds a handle; untracking an object bumps its slot's generation, so any handle to it left in Lua
+// resolves to nullptr from then on instead of dangling. The tracker must outlive every state holding its handles.
+// Each slot remembers the type its object was tracked as, so a handle can't be pushed as a reference to another type.
+//
+// Like the object pools and column stores, a tracker is not synchronised and belongs to one thread at a time.
+class LuaObjectTracker
+{
+public:
+    struct Handle
+    {
+        uint32_t slot;
+        uint32_t generation;
+    };
+
+private:
+    struct Slot
+    {
+        void* object;
+        const void* type;
+        uint32_t generation;
+        uint32_t nextFree;
+    };
+
+    // its address identifies T
+    template <typename T>
+    struct TypeTag
+    {
+        static constexpr char Value = 0;
+    };
+
+    static constexpr uint32_t InvalidSlot = UINT32_MAX;
+
+    std::vector<Slot> _slots;
+    uint32_t _firstFree;
+    size_t _trackedCount;
+
+public:
+    LuaObjectTracker() noexcept;
+
+    LuaObjectTracker(const LuaObjectTracker&) = delete;
+    LuaObjectTracker& operator=(const LuaObjectTracker&) = delete;
+
+private:
+    [[nodiscard]] Handle Track(void* object, const void* type);
+    void Retarget(Handle handle, void* object, const void* type) noexcept;
+
+public:
+    template <typename T>
+    [[nodiscard]] Handle Track(T* object)
+    {
+        return Track(object, &TypeTag<T>::Value);
+    }
+
+    // Call before the object is destroyed, every handle to it is stale afterwards. Stale handles are ignored.
+    void Untrack(Handle handle) noexcept;
+
+    // Points an existing handle at a new address, for objects that get moved. Ignored unless the handle was tracked
+    // as a T.
+    template <typename T>
+    void Retarget(Handle handle, T* object) noexcept
+    {
+        Retarget(handle, object, &TypeTag<T>::Value);
+    }
+
+    // The tracked object, or nullptr if the handle is stale.
+    [[nodiscard]] inline void* Resolve(Handle handle) const noexcept
+    {
+        if (handle.slot >= _slots.size() || _slots[handle.slot].generation != handle.generation)
+        {
+            return nullptr;
+        }
+
+        return _slots[handle.slot].object;
+    }
+
+    // Whether handle is live and was tracked as a T.
+    template <typename T>
+    [[nodiscard]] inline bool Holds(Handle handle) const noexcept
+    {
+        return Resolve(handle) != nullptr && _slots[handle.slot].type == &TypeTag<T>::Value;
+    }
+
+    [[nodiscard]] inline size_t GetTrackedCount() const noexcept
+    {
+        return _trackedCount;
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUAPOOLALLOCATOR_HPP
+#define LUAPOOLALLOCATOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Size-class pool allocator for a single lua_State, installed through LuaManager's lua_Alloc constructor. Small
+// requests (tables, short strings, closures, small userdata) are served from per-size free lists carved out of large
+// arena blocks that are only released when the allocator is destroyed, anything bigger goes to malloc. Nothing here
+// is synchronised: one allocator serves one state, which is exactly what keeps it free of contention.
+class LuaPoolAllocator
+{
+public:
+    struct Statistics
+    {
+        size_t liveBytes;
+        size_t peakBytes;
+        size_t allocationCount;
+        size_t reallocationCount;
+        size_t freeCount;
+        size_t pooledAllocationCount;
+        size_t arenaBytes;
+    };
+
+private:
+    static constexpr size_t Granularity = 16;
+    static constexpr size_t MaxPooledSize = 256;
+    static constexpr size_t SizeClassCount = MaxPooledSize / Granularity;
+
+    struct FreeSlot
+    {
+        FreeSlot* next;
+    };
+
+    std::array<FreeSlot*, SizeClassCount> _freeLists;
+    std::vector<std::unique_ptr<std::byte[]>> _arenaBlocks;
+    size_t _arenaBlockSize;
+    std::byte* _arenaCursor;
+    size_t _arenaRemaining;
+    Statistics _statistics;
+
+    [[nodiscard]] static constexpr bool IsPooled(size_t size) noexcept
+    {
+        return size <= MaxPooledSize;
+    }
+
+    [[nodiscard]] static constexpr size_t GetSizeClass(size_t size) noexcept
+    {
+        return (size + Granularity - 1) / Granularity - 1;
+    }
+
+    void* AllocateBlock(size_t size) noexcept;
+    void FreeBlock(void* ptr, size_t size) noexcept;
+    void* ReallocateBlock(void* ptr, size_t originalSize, size_t newSize) noexcept;
+
+public:
+    explicit LuaPoolAllocator(size_t arenaBlockSize = 64 * 1024) noexcept;
+
+    LuaPoolAllocator(const LuaPoolAllocator&) = delete;
+    LuaPoolAllocator& operator=(const LuaPoolAllocator&) = delete;
+
+    // matches lua_Alloc, with userData being the allocator itself
+    static void* Allocate(void* userData, void* ptr, size_t originalSize, size_t newSize) noexcept;
+
+    [[nodiscard]] inline const Statistics& GetStatistics() const noexcept
+    {
+        return _statistics;
+    }
+};
+
+#endif
\ No newline at end of file
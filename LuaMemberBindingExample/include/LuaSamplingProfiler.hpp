@@ -0,0 +1,64 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUASAMPLINGPROFILER_HPP
+#define LUASAMPLINGPROFILER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <lua.hpp>
+#include <ostream>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Statistical profiler for whatever runs on a lua_State. A timer thread arms a count and return hook once per
+// interval; the hook fires on the Lua thread at the next instruction (or, while a bound C++ function is running, when
+// it returns), records the call stack and disarms itself again. Between samples no hook is installed at all, so the
+// cost is one stack walk per interval.
+//
+// lua_sethook is the one Lua API function that may be called from another thread. Hooks are per Lua thread, so only
+// code running on the state's main thread (which includes everything LuaManager::Execute runs) is sampled. Any hook
+// installed by someone else is replaced while profiling.
+//
+// Samples are written in the collapsed stack format flamegraph.pl and speedscope read: one line per distinct stack,
+// outermost frame first, frames separated by ';', followed by the sample count. C functions, which is where the
+// bound C++ members show up, are marked with [C].
+class LuaSamplingProfiler
+{
+private:
+    // address used as the key of the profiler in the Lua registry
+    static const char RegistryKey;
+
+    lua_State* L;
+    std::chrono::microseconds _interval;
+    std::unordered_map<std::string, uint64_t> _stacks;
+    uint64_t _sampleCount;
+    std::jthread _timer;
+
+    static void Hook(lua_State* L, lua_Debug* debug);
+    void Sample(lua_State* thread);
+    void RunTimer(std::stop_token stopToken);
+
+public:
+    // Starts sampling L immediately, taking one sample every interval.
+    LuaSamplingProfiler(lua_State* L, std::chrono::microseconds interval);
+
+    // Stops sampling. Must happen on the thread running L, before L is closed.
+    ~LuaSamplingProfiler();
+
+    LuaSamplingProfiler(const LuaSamplingProfiler&) = delete;
+    LuaSamplingProfiler& operator=(const LuaSamplingProfiler&) = delete;
+
+    // Only safe to call from the thread running L, as samples are recorded there.
+    void WriteCollapsedStacks(std::ostream& stream) const;
+
+    [[nodiscard]] inline uint64_t GetSampleCount() const noexcept
+    {
+        return _sampleCount;
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUASCHEDULER_HPP
+#define LUASCHEDULER_HPP
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <lua.hpp>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <LuaStack.hpp>
+
+// Runs many script tasks on one lua_State, each in its own Lua thread. A task runs until it finishes or its script
+// waits: on Sleep(seconds), on coroutine.yield() (which just lets the other tasks have a turn) or inside a C++
+// function bound through Async that called one of the Await helpers. Waiting tasks are suspended with lua_yieldk and
+// resumed by Update once their deadline, future or predicate is ready, so thousands of them can share a state
+// without a thread each. C++20 coroutines can in turn co_await a task through Join.
+//
+// The scheduler is single threaded, like the state it drives. It must be destroyed before the state is closed.
+class LuaScheduler
+{
+public:
+    using TaskId = uint64_t;
+    using Clock = std::chrono::steady_clock;
+    using ReadyFunction = std::function<bool()>;
+    // pushes the results of a finished wait onto the task's stack and returns how many there are
+    using CompleteFunction = std::function<int(lua_State*)>;
+    using ErrorHandler = std::function<void(TaskId, const std::string&)>;
+
+    class JoinAwaiter
+    {
+    private:
+        friend class LuaScheduler;
+
+        LuaScheduler& _scheduler;
+        TaskId _task;
+        std::coroutine_handle<> _handle;
+        std::optional<std::string> _error;
+
+    public:
+        JoinAwaiter(LuaScheduler& scheduler, TaskId task) noexcept
+            : _scheduler(scheduler), _task(task), _handle(), _error()
+        {}
+
+        [[nodiscard]] bool await_ready() const noexcept;
+        void await_suspend(std::coroutine_handle<> handle);
+
+        // rethrows an error raised by the task as std::runtime_error
+        void await_resume() const;
+    };
+
+private:
+    enum class WaitKind
+    {
+        None,
+        Deadline,
+        Polled
+    };
+
+    struct Task
+    {
+        lua_State* thread;
+        int threadReference;
+        WaitKind wait;
+        Clock::time_point deadline;
+        ReadyFunction ready;
+        CompleteFunction complete;
+        std::vector<JoinAwaiter*> joiners;
+    };
+
+    using Timer = std::pair<Clock::time_point, TaskId>;
+
+    // address used as the key of the scheduler in the Lua registry
+    static const char RegistryKey;
+
+    lua_State* L;
+    TaskId _nextTask;
+    std::unordered_map<TaskId, Task> _tasks;
+    std::unordered_map<lua_State*, TaskId> _tasksByThread;
+
+    // Every suspended task sits in exactly one of these: a min-heap of deadlines, a list of predicates polled each
+    // Update, or the list of tasks to resume on the next Update.
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> _timers;
+    std::vector<TaskId> _polled;
+    std::vector<TaskId> _runnable;
+    ErrorHandler _errorHandler;
+
+    // Why the last Await helper called on this thread could not wait, raised by Async once the bound function has
+    // returned. Per thread rather than per scheduler, as there may be no scheduler to put it in.
+    static thread_local const char* _waitError;
+
+    [[nodiscard]] static LuaScheduler* FromState(lua_State* L) noexcept;
+    [[nodiscard]] static Task* FindTask(lua_State* thread) noexcept;
+    // the task running on thread if it is able to yield, otherwise nullptr with _waitError set
+    static Task* FindWaitable(lua_State* thread) noexcept;
+    [[nodiscard]] static bool IsWaiting(lua_State* thread) noexcept;
+    static int ResumeWait(lua_State* thread, int status, lua_KContext context);
+    static int Sleep(lua_State* L);
+
+    void Resume(TaskId id);
+    void Finish(TaskId id, const std::string* error);
+
+public:
+    // Installs the scheduler into L, including the Sleep(seconds) global. There can only be one per state.
+    explicit LuaScheduler(lua_State* L);
+    ~LuaScheduler();
+
+    LuaScheduler(const LuaScheduler&) = delete;
+    LuaScheduler& operator=(const LuaScheduler&) = delete;
+
+    // Pops the function on top of L and starts it as a new task on the next Update.
+    TaskId Spawn();
+
+    // Resumes every task whose wait is over, plus every task spawned or yielded since the last Update. Returns the
+    // number of tasks still alive. Must not be called from inside a task or a joined coroutine.
+    size_t Update();
+
+    // Calls Update until no task is left, sleeping until the next deadline while nothing else can make progress.
+    // polling is how long to sleep between Updates while tasks wait on futures or predicates.
+    void RunUntilIdle(Clock::duration polling = std::chrono::milliseconds(1));
+
+    [[nodiscard]] inline bool IsAlive(TaskId task) const noexcept
+    {
+        return _tasks.find(task) != _tasks.end();
+    }
+
+    [[nodiscard]] inline size_t GetTaskCount() const noexcept
+    {
+        return _tasks.size();
+    }
+
+    // Called for errors in tasks nobody has joined. The default prints them to stderr.
+    void SetErrorHandler(ErrorHandler handler);
+
+    // co_await scheduler.Join(task) suspends a C++ coroutine until the task finishes. The coroutine is resumed from
+    // inside Update.
+    [[nodiscard]] JoinAwaiter Join(TaskId task) noexcept
+    {
+        return JoinAwaiter(*this, task);
+    }
+
+    // The Await helpers record what the current task waits on; the task is suspended once the function bound through
+    // Async returns. lua_yieldk and lua_error unwind with longjmp, which would skip C++ destructors, so both only ever
+    // happen in Async after the bound function has returned and its locals are gone: a helper that can't wait, because
+    // L isn't a task or can't yield, returns false and Async raises the error.
+    static bool AwaitFor(lua_State* L, Clock::duration duration);
+    static bool AwaitUntil(lua_State* L, Clock::time_point deadline);
+
+    // Polls ready once per Update, then resumes the task with whatever complete pushes.
+    static bool Await(lua_State* L, ReadyFunction ready, CompleteFunction complete);
+
+    // Resumes the task with the future's value, or raises its exception as a Lua error in the task.
+    template <typename TValue>
+    static bool Await(lua_State* L, std::future<TValue> future)
+    {
+        auto shared = std::make_shared<std::future<TValue>>(std::move(future));
+
+        return Await(L,
+            [shared]() {
+                return shared->wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            },
+            [shared](lua_State* thread) {
+                if constexpr (std::is_void_v<TValue>)
+                {
+                    shared->get();
+                    return 0;
+                }
+                else
+                {
+                    LuaStack<std::decay_t<TValue>>::Push(thread, shared->get());
+                    return 1;
+                }
+            });
+    }
+
+    // Binds Function so that it can wait. If it called an Await helper, the task yields when it returns and the
+    // values the wait completes with become the call's results; otherwise its own results are returned as usual.
+    template <lua_CFunction Function>
+    static int Async(lua_State* L)
+    {
+        // kept aside in case Function runs Lua that calls into another Async function
+        const char* outerError = std::exchange(_waitError, nullptr);
+        int results = Function(L);
+        const char* error = std::exchange(_waitError, outerError);
+
+        if (error != nullptr)
+        {
+            return luaL_error(L, "%s", error);
+        }
+
+        if (!IsWaiting(L))
+        {
+            return results;
+        }
+
+        return lua_yieldk(L, 0, 0, ResumeWait);
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,291 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUASTACK_HPP
+#define LUASTACK_HPP
+
+#include <concepts>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <limits>
+#include <lua.hpp>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Marshalling between C++ values and the Lua stack. Each specialisation provides a Push that leaves exactly one value
+// on the stack and a Check that reads (or raises a Lua error for) the value at a given index.
+template <typename T>
+struct LuaStack;
+
+template <>
+struct LuaStack<bool>
+{
+    static void Push(lua_State* L, bool value) noexcept
+    {
+        lua_pushboolean(L, value ? 1 : 0);
+    }
+
+    static bool Check(lua_State* L, int index) noexcept
+    {
+        // Lua truthiness, so nil and false are the only false values
+        return lua_toboolean(L, index) != 0;
+    }
+};
+
+// Integer types other than bool, which Lua represents as lua_Integer without going through floating point.
+template <typename T>
+concept LuaIntegral = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+
+// Whether value can be stored in T. Unsigned 64 bit integers take every lua_Integer, reinterpreting negative values
+// the way Lua's own unsigned operations (math.ult, %u in string.format) do.
+template <LuaIntegral T>
+[[nodiscard]] constexpr bool LuaIntegerFits(lua_Integer value) noexcept
+{
+    if constexpr (sizeof(T) >= sizeof(lua_Integer))
+    {
+        return true;
+    }
+    else
+    {
+        return value >= static_cast<lua_Integer>(std::numeric_limits<T>::min())
+            && value <= static_cast<lua_Integer>(std::numeric_limits<T>::max());
+    }
+}
+
+template <LuaIntegral T>
+struct LuaStack<T>
+{
+    static void Push(lua_State* L, T value) noexcept
+    {
+        lua_pushinteger(L, static_cast<lua_Integer>(value));
+    }
+
+    static T Check(lua_State* L, int index)
+    {
+        lua_Integer value = luaL_checkinteger(L, index);
+        luaL_argcheck(L, LuaIntegerFits<T>(value), index, "integer out of range");
+        return static_cast<T>(value);
+    }
+};
+
+template <std::floating_point T>
+struct LuaStack<T>
+{
+    static void Push(lua_State* L, T value) noexcept
+    {
+        lua_pushnumber(L, static_cast<lua_Number>(value));
+    }
+
+    static T Check(lua_State* L, int index)
+    {
+        return static_cast<T>(luaL_checknumber(L, index));
+    }
+};
+
+// Enums travel as their underlying integer.
+template <typename T>
+    requires std::is_enum_v<T>
+struct LuaStack<T>
+{
+    using UnderlyingType = std::underlying_type_t<T>;
+
+    static void Push(lua_State* L, T value) noexcept
+    {
+        LuaStack<UnderlyingType>::Push(L, static_cast<UnderlyingType>(value));
+    }
+
+    static T Check(lua_State* L, int index)
+    {
+        return static_cast<T>(LuaStack<UnderlyingType>::Check(L, index));
+    }
+};
+
+template <>
+struct LuaStack<const char*>
+{
+    static void Push(lua_State* L, const char* value) noexcept
+    {
+        lua_pushstring(L, value);
+    }
+
+    // the returned pointer is owned by Lua and is only valid while the value stays on the stack
+    static const char* Check(lua_State* L, int index)
+    {
+        return luaL_checkstring(L, index);
+    }
+};
+
+template <>
+struct LuaStack<std::string>
+{
+    static void Push(lua_State* L, const std::string& value) noexcept
+    {
+        lua_pushlstring(L, value.data(), value.size());
+    }
+
+    static std::string Check(lua_State* L, int index)
+    {
+        size_t length;
+        const char* value = luaL_checklstring(L, index, &length);
+        return std::string(value, length);
+    }
+};
+
+// Decomposes a pointer to member function into its class, return and argument types.
+template <typename TMethod>
+struct LuaMethodTraits;
+
+template <typename TClass, typename TReturn, typename... TArgs>
+struct LuaMethodTraits<TReturn (TClass::*)(TArgs...)>
+{
+    using ClassType = TClass;
+    using ReturnType = TReturn;
+    using ArgumentTypes = std::tuple<std::decay_t<TArgs>...>;
+
+    static constexpr bool IsConst = false;
+};
+
+template <typename TClass, typename TReturn, typename... TArgs>
+struct LuaMethodTraits<TReturn (TClass::*)(TArgs...) const> : LuaMethodTraits<TReturn (TClass::*)(TArgs...)>
+{
+    static constexpr bool IsConst = true;
+};
+
+template <typename TClass, typename TReturn, typename... TArgs>
+struct LuaMethodTraits<TReturn (TClass::*)(TArgs...) noexcept> : LuaMethodTraits<TReturn (TClass::*)(TArgs...)>
+{};
+
+template <typename TClass, typename TReturn, typename... TArgs>
+struct LuaMethodTraits<TReturn (TClass::*)(TArgs...) const noexcept> : LuaMethodTraits<TReturn (TClass::*)(TArgs...) const>
+{};
+
+// What an argument is read into before the call. Every argument is checked before any of them is converted, and a
+// failed check raises a Lua error, which longjmps; owning types are therefore read as views first, so nothing with a
+// destructor is alive while the remaining arguments are checked.
+template <typename T>
+struct LuaArgument
+{
+    using Type = T;
+
+    static Type Check(lua_State* L, int index)
+    {
+        return LuaStack<T>::Check(L, index);
+    }
+};
+
+template <>
+struct LuaArgument<std::string>
+{
+    // only valid while the argument stays on the stack, which it does for the whole call
+    using Type = std::string_view;
+
+    static Type Check(lua_State* L, int index)
+    {
+        size_t length;
+        const char* value = luaL_checklstring(L, index, &length);
+        return std::string_view(value, length);
+    }
+};
+
+// The arguments of Method as LuaCheckArguments reads them.
+template <typename TArgumentTypes>
+struct LuaCheckedArgumentsOf;
+
+template <typename... TArgs>
+struct LuaCheckedArgumentsOf<std::tuple<TArgs...>>
+{
+    using Type = std::tuple<typename LuaArgument<TArgs>::Type...>;
+};
+
+template <auto Method>
+using LuaCheckedArguments = typename LuaCheckedArgumentsOf<typename LuaMethodTraits<decltype(Method)>::ArgumentTypes>::Type;
+
+template <auto Method, size_t... Indices>
+LuaCheckedArguments<Method> LuaCheckArguments(lua_State* L, int firstArgument, std::index_sequence<Indices...>)
+{
+    using ArgumentTypes = typename LuaMethodTraits<decltype(Method)>::ArgumentTypes;
+
+    static_cast<void>(L);
+    static_cast<void>(firstArgument);
+
+    // braced initialisation checks the arguments in order
+    return LuaCheckedArguments<Method>{
+        LuaArgument<std::tuple_element_t<Indices, ArgumentTypes>>::Check(L, firstArgument + static_cast<int>(Indices))...};
+}
+
+// Checks the arguments of Method on the stack starting at firstArgument, raising a Lua error for the first bad one.
+// Nothing in the result has a destructor to skip, so the check can run before anything that does is constructed.
+template <auto Method>
+LuaCheckedArguments<Method> LuaCheckArguments(lua_State* L, int firstArgument)
+{
+    using ArgumentTypes = typename LuaMethodTraits<decltype(Method)>::ArgumentTypes;
+    return LuaCheckArguments<Method>(L, firstArgument, std::make_index_sequence<std::tuple_size_v<ArgumentTypes>>{});
+}
+
+template <auto Method, typename TObject, size_t... Indices>
+int LuaCallMethod(lua_State* L, TObject& object, const LuaCheckedArguments<Method>& arguments, std::index_sequence<Indices...>)
+{
+    using Traits = LuaMethodTraits<decltype(Method)>;
+    using ReturnType = typename Traits::ReturnType;
+    using ArgumentTypes = typename Traits::ArgumentTypes;
+
+    static_cast<void>(arguments);
+
+    if constexpr (std::is_void_v<ReturnType>)
+    {
+        (object.*Method)(static_cast<std::tuple_element_t<Indices, ArgumentTypes>>(std::get<Indices>(arguments))...);
+        return 0;
+    }
+    else
+    {
+        LuaStack<std::decay_t<ReturnType>>::Push(L,
+            (object.*Method)(static_cast<std::tuple_element_t<Indices, ArgumentTypes>>(std::get<Indices>(arguments))...));
+        return 1;
+    }
+}
+
+// Calls Method on object with arguments from LuaCheckArguments, converted to the parameter types only now, then pushes
+// the result (if any). Returns the number of values pushed, ready to be returned from a lua_CFunction.
+template <auto Method, typename TObject>
+int LuaCallMethod(lua_State* L, TObject& object, const LuaCheckedArguments<Method>& arguments)
+{
+    using ArgumentTypes = typename LuaMethodTraits<decltype(Method)>::ArgumentTypes;
+    return LuaCallMethod<Method>(L, object, arguments, std::make_index_sequence<std::tuple_size_v<ArgumentTypes>>{});
+}
+
+// Calls Method on object with its arguments read from the stack starting at firstArgument, then pushes the result
+// (if any). Returns the number of values pushed, ready to be returned from a lua_CFunction.
+template <auto Method, typename TObject>
+int LuaInvokeMethod(lua_State* L, TObject& object, int firstArgument)
+{
+    return LuaCallMethod<Method>(L, object, LuaCheckArguments<Method>(L, firstArgument));
+}
+
+// Runs body, the work of a lua_CFunction, and turns any C++ exception it throws into a Lua error instead of letting it
+// unwind through Lua's C frames. The error is raised once the exception object is gone, as raising it longjmps.
+template <typename TBody>
+int LuaCatchExceptions(lua_State* L, TBody body)
+{
+    char message[256];
+    try
+    {
+        return body();
+    }
+    catch (const std::exception& exception)
+    {
+        std::snprintf(message, sizeof(message), "%s", exception.what());
+    }
+    catch (...)
+    {
+        std::snprintf(message, sizeof(message), "unknown C++ exception");
+    }
+
+    return luaL_error(L, "%s", message);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,102 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUASTATEPOOL_HPP
+#define LUASTATEPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+#include <LuaManager.hpp>
+
+// A fixed set of worker threads, each owning one LuaManager that is created, set up and only ever used on that
+// thread. Jobs go round-robin onto the workers' queues; a worker takes its newest job first and, once its own queue
+// is empty, steals the oldest job from another worker. Jobs submitted with SubmitTo are never stolen.
+//
+// The setup callback runs once per state, on its worker thread, and is where registries get applied. Registries are
+// only read while generating bindings, so one finalised registry can be shared by every worker; anything the bound
+// objects touch (an ElementNodeCache object pool, say) must be safe to use from several threads at once or be kept
+// per worker.
+class LuaStatePool
+{
+public:
+    using SetupFunction = std::function<void(LuaManager&)>;
+    using Job = std::function<void(LuaManager&)>;
+
+    struct Statistics
+    {
+        size_t executedCount;
+        size_t stolenCount;
+    };
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::deque<Job> pinnedJobs;
+        size_t pinnedCount = 0; // guarded by the pool's mutex, counts jobs pinnedJobs will hold once pushed
+        std::atomic<size_t> executedCount = 0;
+        std::atomic<size_t> stolenCount = 0;
+        std::jthread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<size_t> _nextWorker;
+
+    // Jobs are claimed under _mutex before being popped, so a woken worker knows a job is waiting for it somewhere
+    // and nobody sleeps while work is queued.
+    std::mutex _mutex;
+    std::condition_variable_any _workAvailable;
+    std::condition_variable _allDone;
+    size_t _stealableCount;
+    size_t _outstandingCount;
+    std::exception_ptr _firstError;
+
+    void Push(size_t workerIndex, Job job, bool pinned);
+    [[nodiscard]] Job Take(size_t workerIndex, bool pinned);
+    void Run(std::stop_token stopToken, size_t workerIndex, const SetupFunction& setup, std::exception_ptr& setupError,
+        std::latch& ready);
+    void Stop() noexcept;
+
+public:
+    // Starts threadCount workers and blocks until every state has been set up. If any setup throws, the pool is torn
+    // down again and the first exception is rethrown.
+    LuaStatePool(size_t threadCount, SetupFunction setup);
+
+    // Stops and joins the workers. Jobs already running finish, jobs still queued are discarded, so call Wait first to
+    // finish them.
+    ~LuaStatePool();
+
+    LuaStatePool(const LuaStatePool&) = delete;
+    LuaStatePool& operator=(const LuaStatePool&) = delete;
+
+    void Submit(Job job);
+    void Submit(std::string code);
+
+    // Runs job on the given worker's state only, for work that depends on state left behind by earlier jobs there.
+    void SubmitTo(size_t workerIndex, Job job);
+
+    // Blocks until every submitted job has finished, then rethrows the first exception a job threw since the last Wait.
+    void Wait();
+
+    [[nodiscard]] inline size_t GetThreadCount() const noexcept
+    {
+        return _workers.size();
+    }
+
+    [[nodiscard]] Statistics GetStatistics(size_t workerIndex) const;
+};
+
+#endif
\ No newline at end of file
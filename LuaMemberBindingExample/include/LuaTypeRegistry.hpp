@@ -1,379 +1,1492 @@
-// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
-// for more information.
-
-
-#ifndef LUAFUNCTIONREGISTRY_HPP
-#define LUAFUNCTIONREGISTRY_HPP
-
-#include<algorithm>
-#include <functional>
-#include <lua.hpp>
-#include <map>
-#include <optional>
-#include <span>
-#include <stdexcept>
-#include <string>
-#include <string_view>
-#include <variant>
-#include <vector>
-#include <string>
-
-struct FieldReadWriter
-{
-    using FieldAccessorType = std::function<void(void*,lua_State*)>;
-
-    FieldAccessorType getter;
-    FieldAccessorType setter;
-};
-
-class LuaTypeRegistryBase
-{
-public:
-    using FunctionType = std::function<int(lua_State*)>;
-    using Member = std::variant<FunctionType, FieldReadWriter>;
-    using OptionalMemberRef = std::optional<std::reference_wrapper<const Member>>;
-
-protected:
-    std::string _typeName;
-    std::vector<std::reference_wrapper<const LuaTypeRegistryBase>> _baseTypeRegistries;
-    std::map<std::string, Member> _wrappedMembers;
-    std::map<std::string, FunctionType> _freeFunctions;
-
-    LuaTypeRegistryBase(std::string typeName, std::span<std::reference_wrapper<const LuaTypeRegistryBase>> baseTypeRegistries) noexcept
-        : _typeName(typeName),
-            _baseTypeRegistries(baseTypeRegistries.begin(), baseTypeRegistries.end()),
-            _wrappedMembers(),
-            _freeFunctions()
-        {}
-public:
-    [[nodiscard]] inline const std::string& GetTypeName() const noexcept
-    {
-        return _typeName;
-    }
-    
-    [[nodiscard]] inline bool HasBaseRegistries() const noexcept
-    {
-        return !_baseTypeRegistries.empty();
-    }
-
-    [[nodiscard]] inline const std::vector<std::reference_wrapper<const LuaTypeRegistryBase>>& GetBaseRegistries() const noexcept
-    {
-        return _baseTypeRegistries; // TODO: This should really be wrapped in std::span since its C++20 but its not cooperating lol
-    }
-
-    [[nodiscard]] OptionalMemberRef FindNamedMember(std::string_view member) const noexcept
-    {
-        auto it = std::find_if(
-            _wrappedMembers.cbegin(),
-            _wrappedMembers.cend(),
-            [member](auto pair){
-                return member.compare(pair.first) == 0;
-            });
-
-        if (it != _wrappedMembers.cend())
-        {
-            return it->second;
-        }
-
-        for (const auto& registry : _baseTypeRegistries)
-        {
-            auto found = registry.get().FindNamedMember(member);
-            if (found)
-            {
-                return found;
-            }
-        }
-
-        return std::nullopt;
-    }
-};
-
-template<typename> inline constexpr bool always_false_v = false;
-
-template <typename T>
-class LuaTypeRegistry : public LuaTypeRegistryBase
-{
-public:
-    using MemberType = std::variant<bool T::*, const char* T::*, int32_t T::*, std::string T::*>;
-
-private:
-    static int LookupMember(lua_State* L)
-    {
-        // lua_upvalueindex converts an upvalue index to a magic stack index
-        LuaTypeRegistry* self = static_cast<LuaTypeRegistry*>(
-            lua_touserdata(L, lua_upvalueindex(1)));
-
-        void* value = luaL_checkudata(L, 1, self->GetTypeName().c_str());
-        size_t length;
-        const char* memberName = luaL_checklstring(L, 2, &length);
-
-        auto member = self->FindNamedMember(std::string_view{memberName, length});
-        if (!member)
-        {
-            return luaL_error(L, "failed to find key '%s'", memberName);
-        }
-
-        return std::visit([value, L](auto&& member) {
-            using TMember = std::decay_t<decltype(member)>;
-            if constexpr (std::is_same_v<TMember, FunctionType>)
-            {
-                lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(&member)));
-                auto f = [](auto L){
-                    TMember* member = static_cast<TMember*>(lua_touserdata(L, lua_upvalueindex(1)));
-                    return member->operator()(L);
-                };
-                lua_pushcclosure(L, f, 1);
-                return 1;
-            }
-            else if constexpr(std::is_same_v<TMember, FieldReadWriter>)
-            {
-                member.getter(value, L);
-                return 1;
-            }
-            else
-            {
-                static_assert(always_false_v<TMember>, "non-exhaustive visitor");
-                // unreachable but might be needed to make compiler happy
-                return lua_error(L);
-            }
-        }, member.value().get());
-    }
-
-    static int AssignMember(lua_State* L)
-    {
-        // lua_upvalueindex converts an upvalue index to a magic stack index
-        LuaTypeRegistry* self = static_cast<LuaTypeRegistry*>(
-            lua_touserdata(L, lua_upvalueindex(1)));
-
-        void* value = luaL_checkudata(L, 1, self->GetTypeName().c_str());
-        
-        size_t length;
-        const char* memberName = luaL_checklstring(L, 2, &length);
-
-        auto member = self->FindNamedMember(std::string_view{memberName, length});
-        if (!member)
-        {
-            return luaL_error(L, "failed to find key '%s'", memberName);
-        }
-
-        return std::visit([value, L, memberName](auto&& member) {
-            using TMember = std::decay_t<decltype(member)>;
-            if constexpr(std::is_same_v<TMember, FieldReadWriter>)
-            {
-                member.setter(value, L);
-                return 0;
-            }
-            else
-            {
-                return luaL_error(L, "Expected field with name '%s', got member function.", memberName); //TODO: this error probably isn't very good
-            }
-        }, member.value().get());
-    }
-
-    static int CleanupObject(lua_State* L)
-    {
-        // lua_upvalueindex converts an upvalue index to a magic stack index
-        LuaTypeRegistry* self = static_cast<LuaTypeRegistry*>(
-            lua_touserdata(L, lua_upvalueindex(1)));
-
-        T* value = static_cast<T*>(luaL_checkudata(L, 1, self->GetTypeName().c_str()));
-        value->~T();
-        return 0;
-    }
-
-    static int CreateObject(lua_State* L)
-    {
-        LuaTypeRegistry* self = static_cast<LuaTypeRegistry*>(
-            lua_touserdata(L, lua_upvalueindex(1)));
-
-        static_cast<void>(self->Allocate(L));
-
-        return 1;
-    }
-
-public:
-    LuaTypeRegistry(std::string typeName, std::span<std::reference_wrapper<const LuaTypeRegistryBase>> baseTypeRegistries) noexcept
-        : LuaTypeRegistryBase(typeName, baseTypeRegistries)
-        {}
-
-    explicit LuaTypeRegistry(std::string typeName) noexcept
-        : LuaTypeRegistry(
-            typeName,
-            std::span<std::reference_wrapper<const LuaTypeRegistryBase>>{})
-        {}
-
-    void RegisterMethod(const std::string& name, FunctionType func)
-    {
-        if (_wrappedMembers.find(name) != _wrappedMembers.end())
-        {
-            throw std::runtime_error("A Lua type registry cannot have duplicate members.");
-        }
-
-        _wrappedMembers.emplace(name, func);
-    }
-
-    void RegisterFreeFunction(const std::string& name, FunctionType func)
-    {
-        if (_freeFunctions.find(name) != _freeFunctions.end())
-        {
-            throw std::runtime_error("A Lua type registry cannot have duplicate free functions.");
-        }
-
-        _freeFunctions.emplace(name, func);
-    }
-
-    template <typename TMember>
-    void RegisterField(const std::string& name, TMember T::* member)
-    {
-        if (_wrappedMembers.find(name) != _wrappedMembers.end())
-        {
-            throw std::runtime_error("A Lua type registry cannot have duplicate members.");
-        }
-
-        _wrappedMembers.emplace(name,
-        FieldReadWriter 
-        {
-            [member](auto wrappedValue, auto L)
-            {
-                T* value = static_cast<T*>(wrappedValue);
-                if constexpr (std::is_same_v<TMember, bool>)
-                {
-                    lua_pushboolean(L, value->*member ? 1 : 0);
-                }
-                else if constexpr (std::is_same_v<TMember, const char*>)
-                {
-                    lua_pushstring(L, value->*member);
-                }
-                else if constexpr (std::is_same_v<TMember, std::string>)
-                {
-                    lua_pushstring(L, value->*member.c_str());
-                }
-                else if constexpr (std::is_same_v<TMember, int32_t>)
-                {
-                    lua_pushnumber(L, static_cast<lua_Number>(value->*member));
-                }
-                else
-                {
-                    static_assert(always_false_v<TMember>, "non-exhaustive visitor");
-                }
-            },
-            [member](auto wrappedValue, auto L)
-            {
-                auto logTypeError = [](lua_State* L, const char* expected)
-                {
-                    int luaType = lua_type(L, -1);
-                    luaL_error(L, "Expected boolean, got %s.", expected, lua_typename(L, luaType)); // TODO: Figure out the return stuff
-                };
-
-                T* value = static_cast<T*>(wrappedValue);
-                if constexpr (std::is_same_v<TMember, bool>)
-                {
-                    if (!lua_isboolean(L, -1))
-                    {
-                        logTypeError(L, "boolean"); // TODO: Fix this and return somehow.
-                        return;
-                    }
-
-                    bool result = static_cast<bool>(lua_toboolean(L, -1));
-                    value->*member = result;
-                    lua_pop(L, -1);
-                }
-                else if constexpr (std::is_same_v<TMember, const char*>)
-                {
-                    if (!lua_isstring(L, -1))
-                    {
-                        logTypeError(L, "string"); // TODO: Fix this and return somehow.
-                        return;
-                    }
-
-                    const char* result = lua_tostring(L, -1);
-                    value->*member = new const char*[strlen(result) + 1];
-                    strcpy_s(value->*member, result);
-                    lua_pop(L, -1);
-                }
-                else if constexpr (std::is_same_v<TMember, std::string>)
-                {
-                    if (!lua_isstring(L, -1))
-                    {
-                        logTypeError(L, "string"); // TODO: Fix this and return somehow.
-                        return;
-                    }
-
-                    const char* result = lua_tostring(L, -1);
-                    value->*member = std::string(result);
-                    lua_pop(L, -1);
-                }
-                else if constexpr (std::is_same_v<TMember, int32_t>)
-                {
-                    if (!lua_isnumber(L, -1))
-                    {
-                        logTypeError(L, "number"); // TODO: Fix this and return somehow.
-                        return;
-                    }
-
-                    LUA_NUMBER number = lua_tonumber(L, -1);
-                    value->*member = static_cast<int32_t>(number);
-                    lua_pop(L, -1);
-                }
-                else
-                {
-                    static_assert(always_false_v<TMember>, "non-exhaustive visitor");
-                }
-            }
-        });
-    }
-
-    void GenerateBindings(lua_State* L) const
-    {
-        if (!luaL_newmetatable(L, GetTypeName().c_str()))
-        {
-            throw std::runtime_error("This Lua type already exists");
-        }
-
-        luaL_Reg metamethods[] = {
-            {"__index", LookupMember},
-            {"__gc", CleanupObject},
-            {"__newindex", AssignMember},
-            {nullptr, nullptr}
-        };
-
-        // push our upvalue first since luaL_setfuncs wants the table at the top
-        // of the stack
-        lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(this)));
-
-        // use one updata value to keep a reference to this
-        luaL_setfuncs(L, metamethods, 1);
-        lua_pop(L, 1);
-
-        lua_createtable(L, 0, static_cast<int>(_freeFunctions.size() + 1));
-        for (const auto& pair : _freeFunctions)
-        {
-            lua_pushstring(L, pair.first.c_str());
-            lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(&pair.second)));
-            lua_pushcclosure(L, [](lua_State* L) {
-                FunctionType* function = static_cast<FunctionType*>(lua_touserdata(L, lua_upvalueindex(1)));
-                return function->operator()(L);
-            }, 1);
-            lua_rawset(L, -3);
-        }
-
-        lua_pushliteral(L, "Create");
-        lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(this)));
-        lua_pushcclosure(L, CreateObject, 1);
-        lua_rawset(L, -3);
-
-        lua_setglobal(L, GetTypeName().c_str());
-    }
-
-    template <typename... Args>
-    T* Allocate(lua_State* L, Args&&... args)
-    {
-        void* ptr = lua_newuserdata(L, sizeof(T));
-        luaL_setmetatable(L, _typeName.c_str());
-
-        T* value = new (ptr) T(std::forward(args)...);
-        return value;
-    }
-};
-
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+
+#ifndef LUAFUNCTIONREGISTRY_HPP
+#define LUAFUNCTIONREGISTRY_HPP
+
+#include<algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <lua.hpp>
+#include <LuaColumnKernels.hpp>
+#include <LuaColumnStore.hpp>
+#include <LuaMemberList.hpp>
+#include <LuaMemberProfiler.hpp>
+#include <LuaObjectTracker.hpp>
+#include <LuaStack.hpp>
+#include <map>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include <string>
+
+struct FieldReadWriter
+{
+    // Accessors are handed the address of the field itself rather than the object, so they only depend on the field
+    // type and are plain function pointers shared by every field of that type.
+    using FieldAccessorType = void(*)(void*, lua_State*);
+
+    FieldAccessorType getter;
+    FieldAccessorType setter;
+    size_t offset;
+    const LuaFieldType* type;
+
+    [[nodiscard]] inline void* GetFieldAddress(void* object) const noexcept
+    {
+        return static_cast<std::byte*>(object) + offset;
+    }
+};
+
+class LuaTypeRegistryBase
+{
+public:
+    using FunctionType = std::function<int(lua_State*)>;
+    using Member = std::variant<FunctionType, lua_CFunction, FieldReadWriter>;
+    using OptionalMemberRef = std::optional<std::reference_wrapper<const Member>>;
+    using AcquireFunction = void*(*)(void*);
+    using ReleaseFunction = void(*)(void*, void*);
+    using StaticFindFunction = int(*)(std::string_view) noexcept;
+    using FinalizedFunction = void(*)(LuaTypeRegistryBase&);
+
+    // A checked userdata. Owned objects keep whatever their storage mode put in the userdata, references are
+    // already resolved to the object.
+    struct BoundObject
+    {
+        void* storage;
+        bool isReference;
+    };
+
+protected:
+    std::string _typeName;
+    std::vector<std::reference_wrapper<const LuaTypeRegistryBase>> _baseTypeRegistries;
+    std::map<std::string, Member, std::less<>> _wrappedMembers;
+    std::map<std::string, FunctionType> _freeFunctions;
+
+    // Frozen lookup index over _wrappedMembers, built by Finalize(). std::map nodes never move, so the keys and
+    // member pointers stay valid for as long as the registry does.
+    std::unordered_map<std::string_view, const Member*> _memberIndex;
+    bool _finalized;
+
+    // Members registered from a LuaMemberList, in list order, and the list's perfect hash over their names. Checked
+    // before the index, as they are local members and shadow everything else anyway.
+    std::vector<const Member*> _staticMembers;
+    StaticFindFunction _findStaticMember;
+
+    // Optional object pool. With one set, userdata only hold a pointer to an object acquired from the pool and __gc
+    // hands it back instead of destroying it in place.
+    void* _objectPool;
+    AcquireFunction _acquireObject;
+    ReleaseFunction _releaseObject;
+
+    // Optional structure-of-arrays storage. With one set, userdata only hold a LuaColumnStore::Id and every field
+    // lives in a column of the store instead of in an object.
+    LuaColumnStore* _columnStore;
+
+    // Run at the end of Finalize for what the derived registry needs to set up, so finalizing through a base reference
+    // misses nothing. Optional.
+    FinalizedFunction _onFinalized;
+
+    // of the bound type, to check that the columns cover all of it
+    size_t _objectSize;
+    size_t _objectAlignment;
+
+    LuaTypeRegistryBase(std::string typeName, std::span<std::reference_wrapper<const LuaTypeRegistryBase>> baseTypeRegistries,
+        size_t objectSize, size_t objectAlignment) noexcept
+        : _typeName(typeName),
+            _baseTypeRegistries(baseTypeRegistries.begin(), baseTypeRegistries.end()),
+            _wrappedMembers(),
+            _freeFunctions(),
+            _memberIndex(),
+            _finalized(false),
+            _staticMembers(),
+            _findStaticMember(nullptr),
+            _objectPool(nullptr),
+            _acquireObject(nullptr),
+            _releaseObject(nullptr),
+            _columnStore(nullptr),
+            _onFinalized(nullptr),
+            _objectSize(objectSize),
+            _objectAlignment(objectAlignment)
+        {}
+
+    // What the userdata pushed by PushReference holds. There is no __gc, the object belongs to C++.
+    struct LuaObjectReference
+    {
+        LuaObjectTracker* tracker;
+        LuaObjectTracker::Handle handle;
+    };
+
+    // upvalue slots shared by the closures GenerateBindings creates
+    static constexpr int RegistryUpvalue = 1;
+    static constexpr int MetatableUpvalue = 2;
+    static constexpr int ReferenceMetatableUpvalue = 3;
+    static constexpr int MethodCacheUpvalue = 4;
+    static constexpr int MemberKeyUpvalue = 5;
+    // only __gc has this one, in the slot the others use for the method cache
+    static constexpr int FinalizedObjectCounterUpvalue = 4;
+
+    // Fast replacement for luaL_checkudata. The metatable of the value is compared against the one captured as an
+    // upvalue when the bindings were generated, instead of being fetched from the Lua registry by name on every call.
+    static void* CheckUserdata(lua_State* L, int index)
+    {
+        void* value = lua_touserdata(L, index);
+        if (value != nullptr && lua_getmetatable(L, index))
+        {
+            bool matches = lua_rawequal(L, -1, lua_upvalueindex(MetatableUpvalue));
+            lua_pop(L, 1);
+
+            if (matches)
+            {
+                return value;
+            }
+        }
+
+        const LuaTypeRegistryBase* registry = static_cast<const LuaTypeRegistryBase*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+        luaL_typeerror(L, index, registry->GetTypeName().c_str());
+        return nullptr;
+    }
+
+    // CheckUserdata for members, which accept references as well. A reference to an object that has since been
+    // untracked raises a Lua error instead of being resolved.
+    static BoundObject CheckObject(lua_State* L, int index)
+    {
+        void* value = lua_touserdata(L, index);
+        if (value != nullptr && lua_getmetatable(L, index))
+        {
+            bool owned = lua_rawequal(L, -1, lua_upvalueindex(MetatableUpvalue));
+            bool isReference = !owned && lua_rawequal(L, -1, lua_upvalueindex(ReferenceMetatableUpvalue));
+            lua_pop(L, 1);
+
+            if (owned)
+            {
+                return BoundObject{value, false};
+            }
+
+            if (isReference)
+            {
+                const LuaObjectReference* reference = static_cast<const LuaObjectReference*>(value);
+                void* object = reference->tracker->Resolve(reference->handle);
+                if (object != nullptr)
+                {
+                    return BoundObject{object, true};
+                }
+
+                const LuaTypeRegistryBase* registry = static_cast<const LuaTypeRegistryBase*>(
+                    lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+                luaL_error(L, "attempt to use a %s reference whose object no longer exists", registry->GetTypeName().c_str());
+                return BoundObject{nullptr, true};
+            }
+        }
+
+        const LuaTypeRegistryBase* registry = static_cast<const LuaTypeRegistryBase*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+        luaL_typeerror(L, index, registry->GetTypeName().c_str());
+        return BoundObject{nullptr, false};
+    }
+
+    // Resolves the field named by the first argument of a bulk column function, or raises a Lua error
+    static const FieldReadWriter& CheckField(lua_State* L, const LuaTypeRegistryBase* registry)
+    {
+        size_t length;
+        const char* name = luaL_checklstring(L, 1, &length);
+
+        auto member = registry->FindNamedMember(std::string_view{name, length});
+        const FieldReadWriter* field = member ? std::get_if<FieldReadWriter>(&member->get()) : nullptr;
+        if (field == nullptr)
+        {
+            luaL_error(L, "'%s' is not a field of %s", name, registry->GetTypeName().c_str());
+        }
+
+        return *field;
+    }
+
+    template <typename TMember>
+    static std::span<TMember> GetColumn(const LuaTypeRegistryBase* registry, const FieldReadWriter& field) noexcept
+    {
+        LuaColumnStore* store = registry->GetColumnStore();
+        return std::span<TMember>(
+            static_cast<TMember*>(store->GetColumnData(field.offset, LuaFieldTypeOf<std::remove_const_t<TMember>>)),
+            store->GetSize());
+    }
+
+    // ElementNode.CountWhere("Field", value): how many live instances have the given value in a boolean or integer field
+    static int CountWhere(lua_State* L)
+    {
+        const LuaTypeRegistryBase* registry = static_cast<const LuaTypeRegistryBase*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+
+        const FieldReadWriter& field = CheckField(L, registry);
+        if (field.type == &LuaFieldTypeOf<bool>)
+        {
+            luaL_checktype(L, 2, LUA_TBOOLEAN);
+            size_t count = LuaColumnCountEqual(GetColumn<const bool>(registry, field), lua_toboolean(L, 2) != 0);
+            lua_pushinteger(L, static_cast<lua_Integer>(count));
+            return 1;
+        }
+
+        if (field.type == &LuaFieldTypeOf<int32_t>)
+        {
+            int32_t value = LuaStack<int32_t>::Check(L, 2);
+            lua_pushinteger(L, static_cast<lua_Integer>(LuaColumnCountEqual(GetColumn<const int32_t>(registry, field), value)));
+            return 1;
+        }
+
+        return luaL_error(L, "CountWhere only supports boolean and integer fields");
+    }
+
+    // ElementNode.SetAll("Field", value): assigns value to a boolean or integer field of every live instance
+    static int SetAll(lua_State* L)
+    {
+        const LuaTypeRegistryBase* registry = static_cast<const LuaTypeRegistryBase*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+
+        const FieldReadWriter& field = CheckField(L, registry);
+        if (field.type == &LuaFieldTypeOf<bool>)
+        {
+            luaL_checktype(L, 2, LUA_TBOOLEAN);
+            LuaColumnFill(GetColumn<bool>(registry, field), lua_toboolean(L, 2) != 0);
+            return 0;
+        }
+
+        if (field.type == &LuaFieldTypeOf<int32_t>)
+        {
+            LuaColumnFill(GetColumn<int32_t>(registry, field), LuaStack<int32_t>::Check(L, 2));
+            return 0;
+        }
+
+        return luaL_error(L, "SetAll only supports boolean and integer fields");
+    }
+
+    void ThrowIfFinalized() const
+    {
+        if (_finalized)
+        {
+            throw std::runtime_error("A Lua type registry cannot be modified after it has been finalized.");
+        }
+    }
+public:
+    [[nodiscard]] inline const std::string& GetTypeName() const noexcept
+    {
+        return _typeName;
+    }
+    
+    [[nodiscard]] inline bool HasBaseRegistries() const noexcept
+    {
+        return !_baseTypeRegistries.empty();
+    }
+
+    [[nodiscard]] inline const std::vector<std::reference_wrapper<const LuaTypeRegistryBase>>& GetBaseRegistries() const noexcept
+    {
+        return _baseTypeRegistries; // TODO: This should really be wrapped in std::span since its C++20 but its not cooperating lol
+    }
+
+    [[nodiscard]] inline bool UsesObjectPool() const noexcept
+    {
+        return _objectPool != nullptr;
+    }
+
+    [[nodiscard]] inline bool UsesColumnStore() const noexcept
+    {
+        return _columnStore != nullptr;
+    }
+
+    [[nodiscard]] inline LuaColumnStore* GetColumnStore() const noexcept
+    {
+        return _columnStore;
+    }
+
+    // Resolves a checked userdata to the bound object. Not meaningful with a column store, where no object exists.
+    [[nodiscard]] inline void* GetObjectAddress(void* userdata) const noexcept
+    {
+        return UsesObjectPool() ? *static_cast<void**>(userdata) : userdata;
+    }
+
+    [[nodiscard]] inline void* GetFieldAddress(void* userdata, const FieldReadWriter& field) const noexcept
+    {
+        if (UsesColumnStore())
+        {
+            return _columnStore->GetFieldAddress(*static_cast<LuaColumnStore::Id*>(userdata), field.offset);
+        }
+
+        return field.GetFieldAddress(GetObjectAddress(userdata));
+    }
+
+    [[nodiscard]] inline void* GetObjectAddress(BoundObject object) const noexcept
+    {
+        return object.isReference ? object.storage : GetObjectAddress(object.storage);
+    }
+
+    [[nodiscard]] inline void* GetFieldAddress(BoundObject object, const FieldReadWriter& field) const noexcept
+    {
+        return object.isReference ? field.GetFieldAddress(object.storage) : GetFieldAddress(object.storage, field);
+    }
+
+    [[nodiscard]] inline bool IsFinalized() const noexcept
+    {
+        return _finalized;
+    }
+
+    // Builds the hashed member index used by FindNamedMember. The index is flattened over the whole base registry
+    // hierarchy, so inherited members resolve with the same single probe as local ones. Shadowing follows the old
+    // recursive lookup: local members win, then base registries in declaration order, depth first. Call this once
+    // every member has been registered; registering anything afterwards throws.
+    //
+    // Finalizing also freezes the registry. From then on nothing in it changes, GenerateBindings only reads it and
+    // every state refers to the same members through the light userdata upvalues instead of copying them, so one
+    // registry can bind into any number of states on any number of threads without locking. Finalize has to happen
+    // before those threads are started (or otherwise synchronise with them). An object pool or column store is not
+    // part of that guarantee: both are mutated whenever objects are created or collected.
+    void Finalize()
+    {
+        ThrowIfFinalized();
+
+        // bases are walked by reference, so they must already be frozen or the flattened index could go stale
+        for (const auto& registry : _baseTypeRegistries)
+        {
+            if (!registry.get().IsFinalized())
+            {
+                throw std::runtime_error("Base Lua type registries must be finalized before the registries derived from them.");
+            }
+        }
+
+        CollectMembers(_memberIndex);
+
+        // a std::function method finds its object by casting the userdata, which with an object pool or column store
+        // holds a pointer or an id instead of the object
+        if (UsesObjectPool() || UsesColumnStore())
+        {
+            for (const auto& pair : _memberIndex)
+            {
+                if (std::holds_alternative<FunctionType>(*pair.second))
+                {
+                    _memberIndex.clear();
+                    throw std::runtime_error("Methods registered as std::function cannot be used with an object pool or column store, use RegisterMethod<&T::Method> instead.");
+                }
+            }
+        }
+
+        if (UsesColumnStore())
+        {
+            if (_columnStore->GetColumnCount() != 0)
+            {
+                _memberIndex.clear();
+                throw std::runtime_error("A column store can only back a single Lua type registry.");
+            }
+
+            if (!FieldsCoverObject())
+            {
+                _memberIndex.clear();
+                throw std::runtime_error("Every data member of a column stored type must be registered as a field, anything else would be lost between method calls.");
+            }
+
+            for (const auto& pair : _memberIndex)
+            {
+                if (const FieldReadWriter* field = std::get_if<FieldReadWriter>(pair.second))
+                {
+                    _columnStore->AddColumn(field->offset, *field->type);
+                }
+            }
+        }
+
+        _finalized = true;
+
+        if (_onFinalized != nullptr)
+        {
+            _onFinalized(*this);
+        }
+    }
+
+    [[nodiscard]] OptionalMemberRef FindNamedMember(std::string_view member) const noexcept
+    {
+        if (_findStaticMember != nullptr)
+        {
+            int index = _findStaticMember(member);
+            if (index >= 0)
+            {
+                return *_staticMembers[index];
+            }
+        }
+
+        if (_finalized)
+        {
+            auto it = _memberIndex.find(member);
+            if (it != _memberIndex.cend())
+            {
+                return *it->second;
+            }
+
+            return std::nullopt;
+        }
+
+        // not finalized yet, so fall back to the ordered map and walk the bases. std::less<> keeps this
+        // allocation-free too.
+        auto it = _wrappedMembers.find(member);
+        if (it != _wrappedMembers.cend())
+        {
+            return it->second;
+        }
+
+        for (const auto& registry : _baseTypeRegistries)
+        {
+            auto found = registry.get().FindNamedMember(member);
+            if (found)
+            {
+                return found;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+private:
+    // Whether the fields tile the whole object, leaving gaps only where alignment requires padding. Methods on column
+    // stored types run on an object rebuilt from the columns, so a data member without a column would be reset on
+    // every call. C++ can't list the data members of a type, so this goes by layout: an unregistered member small
+    // enough to sit where padding could be goes unnoticed, as do base classes and virtual functions, which are rejected
+    // along with everything else at the start of the object.
+    [[nodiscard]] bool FieldsCoverObject() const
+    {
+        std::vector<const FieldReadWriter*> fields;
+        for (const auto& pair : _memberIndex)
+        {
+            if (const FieldReadWriter* field = std::get_if<FieldReadWriter>(pair.second))
+            {
+                fields.push_back(field);
+            }
+        }
+
+        std::sort(fields.begin(), fields.end(), [](const FieldReadWriter* lhs, const FieldReadWriter* rhs) {
+            return lhs->offset < rhs->offset;
+        });
+
+        auto alignUp = [](size_t offset, size_t alignment) {
+            return (offset + alignment - 1) / alignment * alignment;
+        };
+
+        size_t end = 0;
+        const FieldReadWriter* previous = nullptr;
+        for (const FieldReadWriter* field : fields)
+        {
+            // the same field registered under another name
+            if (previous != nullptr && field->offset == previous->offset && field->type == previous->type)
+            {
+                continue;
+            }
+
+            if (field->offset != alignUp(end, field->type->alignment))
+            {
+                return false;
+            }
+
+            end = field->offset + field->type->size;
+            previous = field;
+        }
+
+        return alignUp(end, _objectAlignment) == _objectSize;
+    }
+
+    void CollectMembers(std::unordered_map<std::string_view, const Member*>& index) const
+    {
+        // try_emplace never overwrites, so whatever was collected first shadows anything found deeper
+        for (const auto& [name, member] : _wrappedMembers)
+        {
+            index.try_emplace(name, &member);
+        }
+
+        for (const auto& registry : _baseTypeRegistries)
+        {
+            registry.get().CollectMembers(index);
+        }
+    }
+};
+
+template<typename> inline constexpr bool always_false_v = false;
+
+// Its address is the Lua registry key of the size_t counting objects of registered types finalized in a state, set by
+// LuaManager for its GC telemetry. GenerateBindings hands it to __gc as an upvalue, so it has to be set first; states
+// without one simply don't count.
+inline const char LuaFinalizedObjectCounterKey = 0;
+
+enum class LuaIndexMode
+{
+    // every key is resolved by the LookupMember C function
+    Dispatch,
+    // methods are put in a plain table that the VM probes natively, only fields fall back to C. If the type has no
+    // fields at all the table itself becomes __index, otherwise a small Lua function in front of LookupMember does.
+    // Method lookups never reach C in this mode, so the profiler doesn't see them.
+    MethodTable
+};
+
+// TProfiler selects whether the bindings are instrumented, see LuaNullProfiler and LuaMemberProfiler.
+template <typename T, typename TProfiler = LuaNullProfiler>
+class LuaTypeRegistry : public LuaTypeRegistryBase
+{
+public:
+    // every field type RegisterField supports, as well as any enum, which is stored as its underlying integer
+    using MemberType = std::variant<
+        bool T::*,
+        const char* T::*,
+        int8_t T::*, int16_t T::*, int32_t T::*, int64_t T::*,
+        uint8_t T::*, uint16_t T::*, uint32_t T::*, uint64_t T::*,
+        float T::*, double T::*,
+        std::string T::*>;
+
+private:
+    // mutable as recording happens through the const registry that bound the state
+    [[no_unique_address]] mutable TProfiler _profiler;
+
+    // __index and __newindex as GenerateBindings installs them, specialised by RegisterMembers for its member list
+    lua_CFunction _lookupMember;
+    lua_CFunction _assignMember;
+
+    // MethodTable mode's __index for types with fields, made by calling this chunk with the method table and the C
+    // lookup. Being a Lua function, it finds methods without the VM ever calling into C.
+    static constexpr const char* MethodTableIndexSource =
+        "local methods, lookup = ...\n"
+        "return function(object, key)\n"
+        "    local method = methods[key]\n"
+        "    if method ~= nil then\n"
+        "        return method\n"
+        "    end\n"
+        "    return lookup(object, key)\n"
+        "end\n";
+
+    // Creates the profiler entries once the registry is finalized, so recording never has to insert.
+    static void RegisterProfilerEntries(LuaTypeRegistryBase& registry)
+    {
+        LuaTypeRegistry& self = static_cast<LuaTypeRegistry&>(registry);
+        for (const auto& pair : self._memberIndex)
+        {
+            self._profiler.Register(LuaProfiledEvent::Index, pair.first);
+            if (std::holds_alternative<FieldReadWriter>(*pair.second))
+            {
+                self._profiler.Register(LuaProfiledEvent::NewIndex, pair.first);
+            }
+        }
+
+        for (const auto& pair : self._freeFunctions)
+        {
+            self._profiler.Register(LuaProfiledEvent::FreeFunction, pair.first);
+        }
+
+        self._profiler.Register(LuaProfiledEvent::Create, "Create");
+    }
+
+    static int CallFunction(lua_State* L)
+    {
+        const FunctionType* function = static_cast<const FunctionType*>(lua_touserdata(L, lua_upvalueindex(1)));
+        return LuaCatchExceptions(L, [function, L]() {
+            return function->operator()(L);
+        });
+    }
+
+    // CallFunction with the function's profiler entry as a second upvalue
+    static int CallProfiledFunction(lua_State* L)
+    {
+        typename TProfiler::Timer timer(
+            static_cast<typename TProfiler::Statistics*>(lua_touserdata(L, lua_upvalueindex(2))), L);
+        int results = CallFunction(L);
+        timer.Stop();
+        return results;
+    }
+
+    // Runs body, timed under the profiler entry for event and name when profiling is enabled.
+    template <typename TBody>
+    static int Profile(const LuaTypeRegistry* self, lua_State* L, LuaProfiledEvent event, std::string_view name, TBody body)
+    {
+        if constexpr (TProfiler::Enabled)
+        {
+            typename TProfiler::Timer timer(self->_profiler.Find(event, name), L);
+            int results = body();
+            timer.Stop();
+            return results;
+        }
+        else
+        {
+            static_cast<void>(self);
+            static_cast<void>(L);
+            static_cast<void>(event);
+            static_cast<void>(name);
+            return body();
+        }
+    }
+
+    static int ProfileReport(lua_State* L)
+    {
+        const LuaTypeRegistry* self = static_cast<const LuaTypeRegistry*>(lua_touserdata(L, lua_upvalueindex(1)));
+        self->_profiler.PushReport(L);
+        return 1;
+    }
+
+    // Resolves the object at stack index 1 and runs invoke(object) on it, returning its result
+    template <auto Method, typename TInvoke>
+    static int InvokeOnObject(lua_State* L, TInvoke invoke)
+    {
+        // the upvalues belong to the registry that generated the bindings, which may be a derived type's registry
+        // when this method was inherited, so only rely on the base interface here
+        const LuaTypeRegistryBase* registry = static_cast<const LuaTypeRegistryBase*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+
+        BoundObject bound = CheckObject(L, 1);
+        if (!bound.isReference && registry->UsesColumnStore())
+        {
+            // there is no object in column storage, so the method runs on a temporary gathered from the row, and
+            // whatever a non-const method changed is scattered back afterwards. Finalize made sure every data member
+            // has a column, and callers check their arguments before getting here, so the temporary is complete and
+            // no Lua error can skip its destructor.
+            if constexpr (std::is_default_constructible_v<T>)
+            {
+                LuaColumnStore::Id id = *static_cast<LuaColumnStore::Id*>(bound.storage);
+
+                T object{};
+                registry->GetColumnStore()->Gather(id, &object, sizeof(T));
+                int results = invoke(object);
+
+                if constexpr (!LuaMethodTraits<decltype(Method)>::IsConst)
+                {
+                    registry->GetColumnStore()->Scatter(id, &object, sizeof(T));
+                }
+
+                return results;
+            }
+            else
+            {
+                return luaL_error(L, "Methods on column stored types need a default constructible type.");
+            }
+        }
+
+        T* object = static_cast<T*>(registry->GetObjectAddress(bound));
+        return invoke(*object);
+    }
+
+    template <auto Method>
+    static int CallMethod(lua_State* L)
+    {
+        return LuaCatchExceptions(L, [L]() {
+            // checked before InvokeOnObject, which may construct a temporary object a failing check would longjmp past
+            LuaCheckedArguments<Method> arguments = LuaCheckArguments<Method>(L, 2);
+            return InvokeOnObject<Method>(L, [L, &arguments](T& object) {
+                return LuaCallMethod<Method>(L, object, arguments);
+            });
+        });
+    }
+
+    // node:AddMany(lhsArray, rhsArray): every argument is an array holding that parameter for each call, the result
+    // is an array of return values. Methods without parameters take the number of calls instead.
+    template <auto Method>
+    static int CallBatchMethod(lua_State* L)
+    {
+        using Traits = LuaMethodTraits<decltype(Method)>;
+        constexpr int argumentCount = static_cast<int>(std::tuple_size_v<typename Traits::ArgumentTypes>);
+        constexpr bool hasResult = !std::is_void_v<typename Traits::ReturnType>;
+
+        lua_Integer count;
+        if constexpr (argumentCount == 0)
+        {
+            count = luaL_checkinteger(L, 2);
+            luaL_argcheck(L, count >= 0, 2, "call count must not be negative");
+        }
+        else
+        {
+            count = -1;
+            for (int argument = 0; argument < argumentCount; ++argument)
+            {
+                luaL_checktype(L, 2 + argument, LUA_TTABLE);
+
+                lua_Integer length = static_cast<lua_Integer>(lua_rawlen(L, 2 + argument));
+                if (count != -1 && length != count)
+                {
+                    return luaL_error(L, "All argument arrays of a batch call must have the same length.");
+                }
+
+                count = length;
+            }
+        }
+
+        luaL_checkstack(L, argumentCount + 3, nullptr);
+
+        if constexpr (hasResult)
+        {
+            lua_createtable(L, static_cast<int>(std::min<lua_Integer>(count, INT_MAX)), 0);
+        }
+
+        int results = lua_gettop(L);
+
+        // with a column store the calls run on a temporary object, which a failing check mustn't longjmp past, so
+        // every call's arguments are checked up front
+        const LuaTypeRegistryBase* registry = static_cast<const LuaTypeRegistryBase*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+        if (registry->UsesColumnStore())
+        {
+            for (lua_Integer i = 1; i <= count; ++i)
+            {
+                for (int argument = 0; argument < argumentCount; ++argument)
+                {
+                    lua_rawgeti(L, 2 + argument, i);
+                }
+
+                static_cast<void>(LuaCheckArguments<Method>(L, results + 1));
+                lua_settop(L, results);
+            }
+        }
+
+        return LuaCatchExceptions(L, [L, count, results]() {
+            return InvokeOnObject<Method>(L, [L, count, results](T& object) {
+                for (lua_Integer i = 1; i <= count; ++i)
+                {
+                    for (int argument = 0; argument < argumentCount; ++argument)
+                    {
+                        lua_rawgeti(L, 2 + argument, i);
+                    }
+
+                    static_cast<void>(LuaInvokeMethod<Method>(L, object, results + 1));
+
+                    if constexpr (hasResult)
+                    {
+                        lua_rawseti(L, results, i);
+                    }
+
+                    lua_settop(L, results);
+                }
+
+                return hasResult ? 1 : 0;
+            });
+        });
+    }
+
+    // Resolves the key at stack index 2 with a raw probe of the member key table GenerateBindings filled. Lua
+    // interns short strings, so the probe hashes nothing and compares pointers rather than characters. With a member
+    // list TList its perfect hash goes first, and the table only has to settle the keys the list doesn't have.
+    template <typename TList>
+    static const Member& CheckMember(const LuaTypeRegistry* self, lua_State* L)
+    {
+        if constexpr (!std::is_void_v<TList>)
+        {
+            if (lua_type(L, 2) == LUA_TSTRING)
+            {
+                size_t length;
+                const char* name = lua_tolstring(L, 2, &length);
+                int index = TList::Find(std::string_view{name, length});
+                if (index >= 0)
+                {
+                    return *self->_staticMembers[static_cast<size_t>(index)];
+                }
+            }
+        }
+        else
+        {
+            static_cast<void>(self);
+        }
+
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(MemberKeyUpvalue));
+        const Member* member = static_cast<const Member*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+
+        if (member == nullptr)
+        {
+            luaL_error(L, "failed to find key '%s'", luaL_tolstring(L, 2, nullptr));
+        }
+
+        return *member;
+    }
+
+    // The key at stack index 2 for the profiler, which is only looked at when profiling is enabled.
+    static std::string_view GetProfiledName(lua_State* L)
+    {
+        if constexpr (TProfiler::Enabled)
+        {
+            size_t length;
+            const char* name = lua_tolstring(L, 2, &length);
+            return std::string_view{name, length};
+        }
+        else
+        {
+            static_cast<void>(L);
+            return std::string_view{};
+        }
+    }
+
+    template <typename TList>
+    static int LookupMember(lua_State* L)
+    {
+        // lua_upvalueindex converts an upvalue index to a magic stack index
+        LuaTypeRegistry* self = static_cast<LuaTypeRegistry*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+
+        BoundObject value = CheckObject(L, 1);
+        const Member& member = CheckMember<TList>(self, L);
+
+        return Profile(self, L, LuaProfiledEvent::Index, GetProfiledName(L), [self, L, value, &member]() {
+            return ReadMember(self, L, value, member);
+        });
+    }
+
+    static int ReadMember(const LuaTypeRegistry* self, lua_State* L, BoundObject value, const Member& member)
+    {
+        return std::visit([self, value, L](auto&& member) {
+            using TMember = std::decay_t<decltype(member)>;
+            if constexpr (std::is_same_v<TMember, FunctionType> || std::is_same_v<TMember, lua_CFunction>)
+            {
+                // GenerateBindings made the closure up front, so this is just a fetch from the cache table
+                lua_rawgetp(L, lua_upvalueindex(MethodCacheUpvalue), &member);
+                return 1;
+            }
+            else if constexpr(std::is_same_v<TMember, FieldReadWriter>)
+            {
+                member.getter(self->GetFieldAddress(value, member), L);
+                return 1;
+            }
+            else
+            {
+                static_assert(always_false_v<TMember>, "non-exhaustive visitor");
+                // unreachable but might be needed to make compiler happy
+                return lua_error(L);
+            }
+        }, member);
+    }
+
+    template <typename TList>
+    static int AssignMember(lua_State* L)
+    {
+        // lua_upvalueindex converts an upvalue index to a magic stack index
+        LuaTypeRegistry* self = static_cast<LuaTypeRegistry*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+
+        BoundObject value = CheckObject(L, 1);
+        const Member& member = CheckMember<TList>(self, L);
+
+        return Profile(self, L, LuaProfiledEvent::NewIndex, GetProfiledName(L), [self, L, value, &member]() {
+            return WriteMember(self, L, value, member);
+        });
+    }
+
+    static int WriteMember(const LuaTypeRegistry* self, lua_State* L, BoundObject value, const Member& member)
+    {
+        return std::visit([self, value, L](auto&& member) {
+            using TMember = std::decay_t<decltype(member)>;
+            if constexpr(std::is_same_v<TMember, FieldReadWriter>)
+            {
+                member.setter(self->GetFieldAddress(value, member), L);
+                return 0;
+            }
+            else
+            {
+                return luaL_error(L, "Expected field with name '%s', got member function.", lua_tostring(L, 2)); //TODO: this error probably isn't very good
+            }
+        }, member);
+    }
+
+    static int CleanupObject(lua_State* L)
+    {
+        LuaTypeRegistry* self = static_cast<LuaTypeRegistry*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+
+        void* userdata = CheckUserdata(L, 1);
+
+        if (size_t* finalizedObjects = static_cast<size_t*>(lua_touserdata(L, lua_upvalueindex(FinalizedObjectCounterUpvalue))))
+        {
+            ++*finalizedObjects;
+        }
+
+        if (self->UsesColumnStore())
+        {
+            self->_columnStore->Destroy(*static_cast<LuaColumnStore::Id*>(userdata));
+        }
+        else if (self->UsesObjectPool())
+        {
+            self->_releaseObject(self->_objectPool, self->GetObjectAddress(userdata));
+        }
+        else
+        {
+            static_cast<T*>(userdata)->~T();
+        }
+
+        return 0;
+    }
+
+    // Numbers keep their Lua subtype: integer fields are pushed as integers and floating point ones as floats.
+    template <typename TMember>
+    static void GetField(void* wrappedField, lua_State* L)
+    {
+        TMember* field = static_cast<TMember*>(wrappedField);
+        if constexpr (std::is_same_v<TMember, bool> || std::is_same_v<TMember, const char*>
+            || std::is_same_v<TMember, std::string> || std::is_arithmetic_v<TMember> || std::is_enum_v<TMember>)
+        {
+            LuaStack<TMember>::Push(L, *field);
+        }
+        else
+        {
+            static_assert(always_false_v<TMember>, "non-exhaustive visitor");
+        }
+    }
+
+    template <typename TMember>
+    static void SetField(void* wrappedField, lua_State* L)
+    {
+        auto logTypeError = [](lua_State* L, const char* expected)
+        {
+            int luaType = lua_type(L, -1);
+            luaL_error(L, "Expected %s, got %s.", expected, lua_typename(L, luaType)); // longjmps, the returns after each call are never reached
+        };
+
+        TMember* field = static_cast<TMember*>(wrappedField);
+        if constexpr (std::is_same_v<TMember, bool>)
+        {
+            if (!lua_isboolean(L, -1))
+            {
+                logTypeError(L, "boolean");
+                return;
+            }
+
+            *field = static_cast<bool>(lua_toboolean(L, -1));
+            lua_pop(L, 1);
+        }
+        else if constexpr (std::is_same_v<TMember, const char*>)
+        {
+            if (!lua_isstring(L, -1))
+            {
+                logTypeError(L, "string");
+                return;
+            }
+
+            const char* result = lua_tostring(L, -1);
+            char* copy = new char[std::strlen(result) + 1];
+            std::strcpy(copy, result);
+            *field = copy;
+            lua_pop(L, 1);
+        }
+        else if constexpr (std::is_same_v<TMember, std::string>)
+        {
+            if (!lua_isstring(L, -1))
+            {
+                logTypeError(L, "string");
+                return;
+            }
+
+            size_t length;
+            const char* result = lua_tolstring(L, -1, &length);
+            field->assign(result, length);
+            lua_pop(L, 1);
+        }
+        else if constexpr (LuaIntegral<TMember> || std::is_enum_v<TMember>)
+        {
+            using TInteger = typename std::conditional_t<std::is_enum_v<TMember>,
+                std::underlying_type<TMember>, std::type_identity<TMember>>::type;
+
+            // integers are taken as they are, floats only if they hold an integral value
+            int isInteger;
+            lua_Integer number = lua_tointegerx(L, -1, &isInteger);
+            if (!isInteger)
+            {
+                logTypeError(L, lua_isnumber(L, -1) ? "integral number" : "number");
+                return;
+            }
+
+            if (!LuaIntegerFits<TInteger>(number))
+            {
+                luaL_error(L, "Integer %I is out of range for this field.", number);
+                return;
+            }
+
+            *field = static_cast<TMember>(static_cast<TInteger>(number));
+            lua_pop(L, 1);
+        }
+        else if constexpr (std::is_floating_point_v<TMember>)
+        {
+            if (!lua_isnumber(L, -1))
+            {
+                logTypeError(L, "number");
+                return;
+            }
+
+            *field = static_cast<TMember>(lua_tonumber(L, -1));
+            lua_pop(L, 1);
+        }
+        else
+        {
+            static_assert(always_false_v<TMember>, "non-exhaustive visitor");
+        }
+    }
+
+    static int CreateObject(lua_State* L)
+    {
+        LuaTypeRegistry* self = static_cast<LuaTypeRegistry*>(
+            lua_touserdata(L, lua_upvalueindex(RegistryUpvalue)));
+
+        // acquiring from a pool, taking a column store id and T's constructor can all throw
+        return LuaCatchExceptions(L, [self, L]() {
+            return Profile(self, L, LuaProfiledEvent::Create, "Create", [self, L]() {
+                static_cast<void>(self->Construct(L));
+
+                // the metatable upvalue saves Allocate's lookup by name
+                lua_pushvalue(L, lua_upvalueindex(MetatableUpvalue));
+                lua_setmetatable(L, -2);
+                return 1;
+            });
+        });
+    }
+
+    // Pushes a new userdata for the object, without a metatable yet. With a column store there is no object to
+    // return, so the result is nullptr.
+    template <typename... Args>
+    T* Construct(lua_State* L, Args&&... args) const
+    {
+        if (UsesColumnStore())
+        {
+            LuaColumnStore::Id* handle = static_cast<LuaColumnStore::Id*>(
+                lua_newuserdatauv(L, sizeof(LuaColumnStore::Id), 0));
+            *handle = _columnStore->Create();
+            if constexpr (sizeof...(Args) > 0)
+            {
+                T value(std::forward<Args>(args)...);
+                _columnStore->Scatter(*handle, &value, sizeof(T));
+            }
+
+            return nullptr;
+        }
+
+        if (UsesObjectPool())
+        {
+            void** handle = static_cast<void**>(lua_newuserdatauv(L, sizeof(void*), 0));
+            T* value = static_cast<T*>(_acquireObject(_objectPool));
+            if constexpr (sizeof...(Args) > 0)
+            {
+                *value = T(std::forward<Args>(args)...);
+            }
+
+            *handle = value;
+            return value;
+        }
+
+        void* ptr = lua_newuserdatauv(L, sizeof(T), 0);
+        return new (ptr) T(std::forward<Args>(args)...);
+    }
+
+    template <const auto& Members, size_t... I>
+    void RegisterListedMembers(std::index_sequence<I...>)
+    {
+        (RegisterListedMember<Members, I>(), ...);
+    }
+
+    template <const auto& Members, size_t I>
+    void RegisterListedMember()
+    {
+        using TEntry = std::tuple_element_t<I, decltype(Members.entries)>;
+        constexpr auto pointer = std::get<I>(Members.entries).pointer;
+
+        std::string name(TEntry::Name);
+        if constexpr (TEntry::IsField)
+        {
+            RegisterField(name, pointer);
+        }
+        else
+        {
+            RegisterMethod<pointer>(name);
+        }
+
+        _staticMembers.push_back(&_wrappedMembers.find(name)->second);
+    }
+
+    void PushMethodTable(lua_State* L, int metatable, int referenceMetatable, bool keyByName, bool keyByAddress) const
+    {
+        lua_createtable(L, 0, static_cast<int>(_memberIndex.size()));
+        for (const auto& pair : _memberIndex)
+        {
+            const void* key;
+            if (const FunctionType* function = std::get_if<FunctionType>(pair.second))
+            {
+                key = function;
+                lua_pushlightuserdata(L, const_cast<void*>(key));
+                lua_pushcclosure(L, CallFunction, 1);
+            }
+            else if (const lua_CFunction* function = std::get_if<lua_CFunction>(pair.second))
+            {
+                key = function;
+                lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(static_cast<const LuaTypeRegistryBase*>(this))));
+                lua_pushvalue(L, metatable);
+                lua_pushvalue(L, referenceMetatable);
+                lua_pushcclosure(L, *function, 3);
+            }
+            else
+            {
+                continue;
+            }
+
+            if (keyByName)
+            {
+                lua_pushlstring(L, pair.first.data(), pair.first.size());
+                lua_pushvalue(L, -2);
+                lua_rawset(L, -4);
+            }
+
+            if (keyByAddress)
+            {
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, -3, key);
+            }
+
+            lua_pop(L, 1);
+        }
+    }
+
+public:
+    LuaTypeRegistry(std::string typeName, std::span<std::reference_wrapper<const LuaTypeRegistryBase>> baseTypeRegistries) noexcept
+        : LuaTypeRegistryBase(typeName, baseTypeRegistries, sizeof(T), alignof(T)),
+            _profiler(),
+            _lookupMember(LookupMember<void>),
+            _assignMember(AssignMember<void>)
+        {
+            if constexpr (TProfiler::Enabled)
+            {
+                _onFinalized = RegisterProfilerEntries;
+            }
+        }
+
+    explicit LuaTypeRegistry(std::string typeName) noexcept
+        : LuaTypeRegistry(
+            typeName,
+            std::span<std::reference_wrapper<const LuaTypeRegistryBase>>{})
+        {}
+
+    [[nodiscard]] inline const TProfiler& GetProfiler() const noexcept
+    {
+        return _profiler;
+    }
+
+    // The function gets the userdata itself as argument 1 and has to find the object in it on its own, so this only
+    // suits types whose objects live inline in their userdata. Finalize rejects these methods once an object pool or
+    // column store is set.
+    void RegisterMethod(const std::string& name, FunctionType func)
+    {
+        ThrowIfFinalized();
+
+        if (_wrappedMembers.find(name) != _wrappedMembers.end())
+        {
+            throw std::runtime_error("A Lua type registry cannot have duplicate members.");
+        }
+
+        _wrappedMembers.emplace(name, func);
+    }
+
+    // Binds a member function without any std::function in the way. Argument and return marshalling is worked out
+    // from the signature at compile time through LuaStack, e.g. RegisterMethod<&ElementNode::Add>("Add").
+    template <auto Method>
+    void RegisterMethod(const std::string& name)
+    {
+        using TClass = typename LuaMethodTraits<decltype(Method)>::ClassType;
+        static_assert(std::is_base_of_v<TClass, T>, "Method must be a member function of T or one of its bases.");
+
+        ThrowIfFinalized();
+
+        if (_wrappedMembers.find(name) != _wrappedMembers.end())
+        {
+            throw std::runtime_error("A Lua type registry cannot have duplicate members.");
+        }
+
+        _wrappedMembers.emplace(name, Member{std::in_place_type<lua_CFunction>, CallMethod<Method>});
+    }
+
+    // Objects created for Lua are taken from pool.Acquire() and handed back through pool.Release(T*) when collected,
+    // instead of living inside their userdata. The pool must outlive every state the bindings are applied to.
+    // Methods have to be registered with RegisterMethod<&T::Method>, see RegisterMethod(name, FunctionType).
+    template <typename TPool>
+    void SetObjectPool(TPool& pool)
+    {
+        ThrowIfFinalized();
+
+        if (UsesColumnStore())
+        {
+            throw std::runtime_error("A Lua type registry cannot use both an object pool and a column store.");
+        }
+
+        _objectPool = &pool;
+        _acquireObject = [](void* pool) -> void* {
+            return static_cast<TPool*>(pool)->Acquire();
+        };
+        _releaseObject = [](void* pool, void* object) {
+            static_cast<TPool*>(pool)->Release(static_cast<T*>(object));
+        };
+    }
+
+    // Instances created for Lua live in store's columns, one per registered field, and userdata only hold their id.
+    // Fields are read and written in place; methods run on a temporary copy of the row, so every data member of T has
+    // to be registered as a field, which Finalize checks. The store must outlive every state the bindings are applied
+    // to, and is given its columns when the registry is finalized. As with an object pool, methods have to be
+    // registered with RegisterMethod<&T::Method>.
+    void SetColumnStore(LuaColumnStore& store)
+    {
+        ThrowIfFinalized();
+
+        if (UsesObjectPool())
+        {
+            throw std::runtime_error("A Lua type registry cannot use both an object pool and a column store.");
+        }
+
+        _columnStore = &store;
+    }
+
+    // Registers a batch variant of Method that handles a whole array of calls per crossing into C++, see
+    // CallBatchMethod. e.g. RegisterBatchMethod<&ElementNode::Add>("AddMany") lets Lua call node:AddMany(as, bs).
+    template <auto Method>
+    void RegisterBatchMethod(const std::string& name)
+    {
+        using TClass = typename LuaMethodTraits<decltype(Method)>::ClassType;
+        static_assert(std::is_base_of_v<TClass, T>, "Method must be a member function of T or one of its bases.");
+
+        ThrowIfFinalized();
+
+        if (_wrappedMembers.find(name) != _wrappedMembers.end())
+        {
+            throw std::runtime_error("A Lua type registry cannot have duplicate members.");
+        }
+
+        _wrappedMembers.emplace(name, Member{std::in_place_type<lua_CFunction>, CallBatchMethod<Method>});
+    }
+
+    void RegisterFreeFunction(const std::string& name, FunctionType func)
+    {
+        ThrowIfFinalized();
+
+        if (_freeFunctions.find(name) != _freeFunctions.end())
+        {
+            throw std::runtime_error("A Lua type registry cannot have duplicate free functions.");
+        }
+
+        _freeFunctions.emplace(name, func);
+    }
+
+    template <typename TMember>
+    void RegisterField(const std::string& name, TMember T::* member)
+    {
+        ThrowIfFinalized();
+
+        if (_wrappedMembers.find(name) != _wrappedMembers.end())
+        {
+            throw std::runtime_error("A Lua type registry cannot have duplicate members.");
+        }
+
+        _wrappedMembers.emplace(name, FieldReadWriter{GetField<TMember>, SetField<TMember>, LuaGetMemberOffset(member), &LuaFieldTypeOf<TMember>});
+    }
+
+    // Registers a whole LuaMemberList, whose names are fixed at compile time:
+    //     static constexpr auto members = LuaMembers(
+    //         LuaField<"PointlessBool">(&ElementNode::pointlessBool),
+    //         LuaMethod<"Add">(&ElementNode::Add));
+    //     registry.RegisterMembers<members>();
+    // The members behave exactly like ones registered one by one, but FindNamedMember and the generated __index and
+    // __newindex try the list's perfect hash first, which resolves them without hashing the whole name or probing a
+    // table. Only one list can be registered.
+    template <const auto& Members>
+    void RegisterMembers()
+    {
+        using TList = std::remove_cvref_t<decltype(Members)>;
+
+        ThrowIfFinalized();
+
+        if (_findStaticMember != nullptr)
+        {
+            throw std::runtime_error("A Lua type registry can only register one member list.");
+        }
+
+        _staticMembers.clear();
+        RegisterListedMembers<Members>(std::make_index_sequence<TList::Count>{});
+        _findStaticMember = TList::Find;
+        _lookupMember = LookupMember<TList>;
+        _assignMember = AssignMember<TList>;
+    }
+
+    void GenerateBindings(lua_State* L, LuaIndexMode mode = LuaIndexMode::Dispatch) const
+    {
+        if (!IsFinalized())
+        {
+            throw std::runtime_error("A Lua type registry must be finalized before generating bindings.");
+        }
+
+        if (!luaL_newmetatable(L, GetTypeName().c_str()))
+        {
+            throw std::runtime_error("This Lua type already exists");
+        }
+
+        int metatable = lua_absindex(L, -1);
+
+        // References get a metatable of their own, which has no __gc and lives in the Lua registry under the
+        // address of this registry for PushReference to find.
+        lua_createtable(L, 0, 3);
+        int referenceMetatable = lua_absindex(L, -1);
+        lua_pushliteral(L, "__name");
+        lua_pushfstring(L, "%s reference", GetTypeName().c_str());
+        lua_rawset(L, referenceMetatable);
+        lua_pushvalue(L, referenceMetatable);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, this);
+
+        // Every closure gets a reference to this and to both metatables, the latter let CheckObject compare
+        // identities instead of looking up names.
+        auto pushUpvalues = [this, L, metatable, referenceMetatable]() {
+            lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(this)));
+            lua_pushvalue(L, metatable);
+            lua_pushvalue(L, referenceMetatable);
+        };
+
+        lua_pushliteral(L, "__gc");
+        pushUpvalues();
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &LuaFinalizedObjectCounterKey);
+        lua_pushcclosure(L, CleanupObject, 4);
+        lua_rawset(L, metatable);
+
+        // __index and __newindex resolve keys through a table from each member name, interned into L here, to the
+        // member itself
+        lua_createtable(L, 0, static_cast<int>(_memberIndex.size()));
+        int memberKeys = lua_absindex(L, -1);
+        for (const auto& pair : _memberIndex)
+        {
+            lua_pushlstring(L, pair.first.data(), pair.first.size());
+            lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(pair.second)));
+            lua_rawset(L, memberKeys);
+        }
+
+        lua_pushliteral(L, "__newindex");
+        pushUpvalues();
+        lua_pushnil(L); // no method cache
+        lua_pushvalue(L, memberKeys);
+        lua_pushcclosure(L, _assignMember, 5);
+        lua_pushliteral(L, "__newindex");
+        lua_pushvalue(L, -2);
+        lua_rawset(L, referenceMetatable);
+        lua_rawset(L, metatable);
+
+        // __index additionally gets a cache holding one closure per method, keyed by the address of the wrapped
+        // function, so looking up a method never allocates. In MethodTable mode the closures are keyed by name too.
+        bool hasFields = std::any_of(_memberIndex.cbegin(), _memberIndex.cend(), [](const auto& pair) {
+            return std::holds_alternative<FieldReadWriter>(*pair.second);
+        });
+
+        lua_pushliteral(L, "__index");
+        if (mode == LuaIndexMode::MethodTable && !hasFields)
+        {
+            PushMethodTable(L, metatable, referenceMetatable, true, false);
+        }
+        else if (mode == LuaIndexMode::MethodTable)
+        {
+            if (luaL_loadbuffer(L, MethodTableIndexSource, std::strlen(MethodTableIndexSource), "=MethodTableIndex") != LUA_OK)
+            {
+                std::string message(lua_tostring(L, -1));
+                lua_settop(L, metatable - 1);
+                throw std::runtime_error(message);
+            }
+
+            // the one table serves both, the Lua side probes it by name and the C lookup by address
+            PushMethodTable(L, metatable, referenceMetatable, true, true);
+            pushUpvalues();
+            lua_pushvalue(L, -4);
+            lua_pushvalue(L, memberKeys);
+            lua_pushcclosure(L, _lookupMember, 5);
+            lua_call(L, 2, 1);
+        }
+        else
+        {
+            pushUpvalues();
+            PushMethodTable(L, metatable, referenceMetatable, false, true);
+            lua_pushvalue(L, memberKeys);
+            lua_pushcclosure(L, _lookupMember, 5);
+        }
+        lua_pushliteral(L, "__index");
+        lua_pushvalue(L, -2);
+        lua_rawset(L, referenceMetatable);
+        lua_rawset(L, metatable);
+        lua_pop(L, 1);
+
+        lua_createtable(L, 0, static_cast<int>(_freeFunctions.size() + 3));
+        for (const auto& pair : _freeFunctions)
+        {
+            lua_pushstring(L, pair.first.c_str());
+            lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(&pair.second)));
+            if constexpr (TProfiler::Enabled)
+            {
+                lua_pushlightuserdata(L, _profiler.Find(LuaProfiledEvent::FreeFunction, pair.first));
+                lua_pushcclosure(L, CallProfiledFunction, 2);
+            }
+            else
+            {
+                lua_pushcclosure(L, CallFunction, 1);
+            }
+            lua_rawset(L, -3);
+        }
+
+        if constexpr (TProfiler::Enabled)
+        {
+            lua_pushliteral(L, "ProfileReport");
+            lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(this)));
+            lua_pushcclosure(L, ProfileReport, 1);
+            lua_rawset(L, -3);
+        }
+
+        if (UsesColumnStore())
+        {
+            // bulk operations straight over the packed columns, one call for every live instance
+            lua_pushliteral(L, "CountWhere");
+            lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(this)));
+            lua_pushcclosure(L, CountWhere, 1);
+            lua_rawset(L, -3);
+
+            lua_pushliteral(L, "SetAll");
+            lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(this)));
+            lua_pushcclosure(L, SetAll, 1);
+            lua_rawset(L, -3);
+        }
+
+        lua_pushliteral(L, "Create");
+        lua_pushlightuserdata(L, const_cast<void*>(static_cast<const void*>(this)));
+        lua_pushvalue(L, metatable);
+        lua_pushcclosure(L, CreateObject, 2);
+        lua_rawset(L, -3);
+
+        lua_setglobal(L, GetTypeName().c_str());
+        lua_pop(L, 2);
+    }
+
+    // Pushes a non-owning reference to an object C++ owns and tracks in tracker. The userdata only holds the handle
+    // and has no finalizer, so nothing happens to the object when Lua collects it; once the object is untracked,
+    // using the reference raises a Lua error instead. The bindings must have been generated for L already, and the
+    // handle has to be live and tracked as a T.
+    void PushReference(lua_State* L, LuaObjectTracker& tracker, LuaObjectTracker::Handle handle) const
+    {
+        if (!tracker.Holds<T>(handle))
+        {
+            throw std::runtime_error("The handle does not refer to a tracked " + _typeName + ".");
+        }
+
+        if (lua_rawgetp(L, LUA_REGISTRYINDEX, this) != LUA_TTABLE)
+        {
+            lua_pop(L, 1);
+            throw std::runtime_error("Bindings must be generated before pushing references.");
+        }
+
+        LuaObjectReference* reference = static_cast<LuaObjectReference*>(lua_newuserdatauv(L, sizeof(LuaObjectReference), 0));
+        reference->tracker = &tracker;
+        reference->handle = handle;
+
+        lua_rotate(L, -2, 1);
+        lua_setmetatable(L, -2);
+    }
+
+    // Returns nullptr when the registry uses a column store, see Construct.
+    template <typename... Args>
+    T* Allocate(lua_State* L, Args&&... args) const
+    {
+        T* value = Construct(L, std::forward<Args>(args)...);
+        luaL_setmetatable(L, _typeName.c_str());
+        return value;
+    }
+};
+
 #endif
\ No newline at end of file
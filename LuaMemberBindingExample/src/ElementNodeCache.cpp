@@ -1,2 +1,48 @@
-// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
-// for more information.
\ No newline at end of file
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <ElementNodeCache.hpp>
+#include <new>
+
+ElementNodeCache::ElementNodeCache() noexcept : _slabs(), _freeList(nullptr), _liveCount(0)
+{}
+
+void ElementNodeCache::AddSlab()
+{
+    std::unique_ptr<Slot[]> slab = std::make_unique<Slot[]>(SlabSize);
+
+    // thread the new slots onto the free list back to front so they get handed out in address order
+    for (size_t i = SlabSize; i-- > 0;)
+    {
+        slab[i].next = _freeList;
+        _freeList = &slab[i];
+    }
+
+    _slabs.push_back(std::move(slab));
+}
+
+ElementNode* ElementNodeCache::Acquire()
+{
+    if (_freeList == nullptr)
+    {
+        AddSlab();
+    }
+
+    Slot* slot = _freeList;
+    _freeList = slot->next;
+
+    ElementNode* node = new (&slot->node) ElementNode();
+    ++_liveCount;
+    return node;
+}
+
+void ElementNodeCache::Release(ElementNode* node) noexcept
+{
+    node->~ElementNode();
+
+    // the node is the first member of its slot, so the two addresses are interchangeable
+    Slot* slot = reinterpret_cast<Slot*>(node);
+    slot->next = _freeList;
+    _freeList = slot;
+    --_liveCount;
+}
\ No newline at end of file
@@ -0,0 +1,161 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <LuaBytecodeCache.hpp>
+#include <random>
+#include <string>
+#include <system_error>
+
+namespace
+{
+    constexpr char EntryMagic[4] = {'L', 'B', 'C', '2'};
+
+    struct EntryReader
+    {
+        std::ifstream& file;
+        std::array<char, 4096> buffer;
+    };
+
+    // lua_load pulls the chunk through this in buffer-sized pieces rather than us reading the whole file up front
+    const char* ReadEntry(lua_State*, void* data, size_t* size)
+    {
+        EntryReader* reader = static_cast<EntryReader*>(data);
+        reader->file.read(reader->buffer.data(), static_cast<std::streamsize>(reader->buffer.size()));
+        *size = static_cast<size_t>(reader->file.gcount());
+        return *size > 0 ? reader->buffer.data() : nullptr;
+    }
+
+    int WriteEntry(lua_State*, const void* data, size_t size, void* userData)
+    {
+        std::ofstream* file = static_cast<std::ofstream*>(userData);
+        file->write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        return file->good() ? 0 : 1;
+    }
+}
+
+LuaBytecodeCache::LuaBytecodeCache(std::filesystem::path directory) : _directory(std::move(directory))
+{
+    std::filesystem::create_directories(_directory);
+}
+
+LuaBytecodeCache::Header LuaBytecodeCache::MakeHeader(std::string_view source) noexcept
+{
+    Header header{};
+    std::memcpy(header.magic, EntryMagic, sizeof(EntryMagic));
+    header.luaVersion = LUA_VERSION_NUM;
+    header.sourceHash = HashSource(source);
+    header.sourceSize = source.size();
+    return header;
+}
+
+std::filesystem::path LuaBytecodeCache::GetEntryPath(const Header& header) const
+{
+    std::array<char, 16> name{};
+    auto result = std::to_chars(name.data(), name.data() + name.size(), header.sourceHash, 16);
+    return _directory / (std::string(name.data(), result.ptr) + ".luac");
+}
+
+bool LuaBytecodeCache::TryLoadEntry(lua_State* L, const std::filesystem::path& path, const Header& expected,
+    std::string_view source, const char* chunkName) const
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    Header header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(&header, &expected, sizeof(header)) != 0)
+    {
+        return false;
+    }
+
+    // the header already matched the length, so this only reads as much as we compare
+    std::string storedSource(source.size(), '\0');
+    if (!file.read(storedSource.data(), static_cast<std::streamsize>(storedSource.size())) || storedSource != source)
+    {
+        return false;
+    }
+
+    // lua_load checks the bytecode header itself too, so a dump from an incompatible build is rejected here as well
+    EntryReader reader{file, {}};
+    if (lua_load(L, ReadEntry, &reader, chunkName, "b") != LUA_OK)
+    {
+        lua_pop(L, 1);
+        return false;
+    }
+
+    return true;
+}
+
+void LuaBytecodeCache::StoreEntry(lua_State* L, const std::filesystem::path& path, const Header& header,
+    std::string_view source) const
+{
+    // Write next to the entry and rename over it, so a crash mid-write never leaves a truncated entry behind. The
+    // name is random per write, as two writers sharing one temporary file could interleave into a corrupt entry.
+    thread_local std::mt19937_64 random{std::random_device{}()};
+    std::array<char, 16> suffix{};
+    auto result = std::to_chars(suffix.data(), suffix.data() + suffix.size(), random(), 16);
+
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += ".";
+    temporaryPath += std::string_view(suffix.data(), static_cast<size_t>(result.ptr - suffix.data()));
+    temporaryPath += ".tmp";
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header))
+            || !file.write(source.data(), static_cast<std::streamsize>(source.size()))
+            || lua_dump(L, WriteEntry, &file, 0) != 0)
+        {
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+
+    // the cache is best effort, failing to store an entry just means compiling again next time
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temporaryPath, error);
+    }
+}
+
+int LuaBytecodeCache::Load(lua_State* L, std::string_view source, const char* chunkName) const
+{
+    Header header = MakeHeader(source);
+    std::filesystem::path path = GetEntryPath(header);
+
+    if (TryLoadEntry(L, path, header, source, chunkName))
+    {
+        return LUA_OK;
+    }
+
+    int status = luaL_loadbufferx(L, source.data(), source.size(), chunkName, "t");
+    if (status == LUA_OK)
+    {
+        StoreEntry(L, path, header, source);
+    }
+
+    return status;
+}
+
+uint64_t LuaBytecodeCache::HashSource(std::string_view source) noexcept
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : source)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
\ No newline at end of file
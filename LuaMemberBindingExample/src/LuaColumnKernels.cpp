@@ -0,0 +1,141 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <LuaColumnKernels.hpp>
+
+#if defined(__AVX2__)
+#define LUA_COLUMN_KERNELS_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LUA_COLUMN_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+size_t LuaColumnCountEqual(std::span<const bool> column, bool value) noexcept
+{
+    // bools are stored as single 0 or 1 bytes, so compare them as bytes
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(column.data());
+    size_t size = column.size();
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(LUA_COLUMN_KERNELS_AVX2)
+    const __m256i needle = _mm256_set1_epi8(value ? 1 : 0);
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        count += static_cast<size_t>(std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)))));
+    }
+#elif defined(LUA_COLUMN_KERNELS_SSE2)
+    const __m128i needle = _mm_set1_epi8(value ? 1 : 0);
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        count += static_cast<size_t>(std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)))));
+    }
+#endif
+
+    unsigned char expected = value ? 1 : 0;
+    for (; i < size; ++i)
+    {
+        count += data[i] == expected ? 1 : 0;
+    }
+
+    return count;
+}
+
+size_t LuaColumnCountEqual(std::span<const int32_t> column, int32_t value) noexcept
+{
+    const int32_t* data = column.data();
+    size_t size = column.size();
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(LUA_COLUMN_KERNELS_AVX2)
+    const __m256i needle = _mm256_set1_epi32(value);
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256 matches = _mm256_castsi256_ps(_mm256_cmpeq_epi32(chunk, needle));
+        count += static_cast<size_t>(std::popcount(static_cast<uint32_t>(_mm256_movemask_ps(matches))));
+    }
+#elif defined(LUA_COLUMN_KERNELS_SSE2)
+    const __m128i needle = _mm_set1_epi32(value);
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128 matches = _mm_castsi128_ps(_mm_cmpeq_epi32(chunk, needle));
+        count += static_cast<size_t>(std::popcount(static_cast<uint32_t>(_mm_movemask_ps(matches))));
+    }
+#endif
+
+    for (; i < size; ++i)
+    {
+        count += data[i] == value ? 1 : 0;
+    }
+
+    return count;
+}
+
+void LuaColumnFill(std::span<bool> column, bool value) noexcept
+{
+    // memset is already as wide as the target allows
+    std::memset(column.data(), value ? 1 : 0, column.size());
+}
+
+void LuaColumnFill(std::span<int32_t> column, int32_t value) noexcept
+{
+    int32_t* data = column.data();
+    size_t size = column.size();
+    size_t i = 0;
+
+#if defined(LUA_COLUMN_KERNELS_AVX2)
+    const __m256i values = _mm256_set1_epi32(value);
+    for (; i + 8 <= size; i += 8)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), values);
+    }
+#elif defined(LUA_COLUMN_KERNELS_SSE2)
+    const __m128i values = _mm_set1_epi32(value);
+    for (; i + 4 <= size; i += 4)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), values);
+    }
+#endif
+
+    for (; i < size; ++i)
+    {
+        data[i] = value;
+    }
+}
+
+void LuaColumnAdd(std::span<const int32_t> lhs, std::span<const int32_t> rhs, std::span<int32_t> result) noexcept
+{
+    size_t size = std::min({lhs.size(), rhs.size(), result.size()});
+    size_t i = 0;
+
+#if defined(LUA_COLUMN_KERNELS_AVX2)
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs.data() + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs.data() + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(result.data() + i), _mm256_add_epi32(a, b));
+    }
+#elif defined(LUA_COLUMN_KERNELS_SSE2)
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs.data() + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs.data() + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(result.data() + i), _mm_add_epi32(a, b));
+    }
+#endif
+
+    for (; i < size; ++i)
+    {
+        // add as unsigned so overflow wraps the same way the vector paths do instead of being undefined
+        result[i] = static_cast<int32_t>(static_cast<uint32_t>(lhs[i]) + static_cast<uint32_t>(rhs[i]));
+    }
+}
\ No newline at end of file
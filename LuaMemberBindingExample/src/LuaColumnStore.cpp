@@ -0,0 +1,202 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <algorithm>
+#include <LuaColumnStore.hpp>
+
+LuaColumnStore::LuaColumnStore() noexcept
+    : _columns(), _rowOfId(), _idOfRow(), _freeIds(), _size(0), _capacity(0)
+{}
+
+LuaColumnStore::~LuaColumnStore()
+{
+    for (const Column& column : _columns)
+    {
+        for (size_t row = 0; row < _size; ++row)
+        {
+            column.type->destroy(GetElement(column, row));
+        }
+
+        ::operator delete(column.data, std::align_val_t{column.type->alignment});
+    }
+}
+
+void LuaColumnStore::AddColumn(size_t offset, const LuaFieldType& type)
+{
+    if (_size != 0)
+    {
+        throw std::runtime_error("Columns cannot be added to a column store that already holds rows.");
+    }
+
+    if (FindColumn(offset) != nullptr)
+    {
+        // the same member registered under another name
+        return;
+    }
+
+    std::byte* data = nullptr;
+    if (_capacity != 0)
+    {
+        data = static_cast<std::byte*>(::operator new(_capacity * type.size, std::align_val_t{type.alignment}));
+    }
+
+    _columns.push_back(Column{offset, &type, data});
+}
+
+void LuaColumnStore::Grow()
+{
+    size_t capacity = std::max<size_t>(_capacity * 2, 64);
+
+    // allocate everything up front so a failure leaves the store untouched
+    std::vector<std::byte*> grown;
+    grown.reserve(_columns.size());
+    try
+    {
+        for (const Column& column : _columns)
+        {
+            grown.push_back(static_cast<std::byte*>(
+                ::operator new(capacity * column.type->size, std::align_val_t{column.type->alignment})));
+        }
+    }
+    catch (...)
+    {
+        for (size_t i = 0; i < grown.size(); ++i)
+        {
+            ::operator delete(grown[i], std::align_val_t{_columns[i].type->alignment});
+        }
+
+        throw;
+    }
+
+    for (size_t i = 0; i < _columns.size(); ++i)
+    {
+        Column& column = _columns[i];
+        for (size_t row = 0; row < _size; ++row)
+        {
+            std::byte* source = GetElement(column, row);
+            column.type->moveConstruct(grown[i] + row * column.type->size, source);
+            column.type->destroy(source);
+        }
+
+        ::operator delete(column.data, std::align_val_t{column.type->alignment});
+        column.data = grown[i];
+    }
+
+    _capacity = capacity;
+}
+
+const LuaColumnStore::Column* LuaColumnStore::FindColumn(size_t offset) const noexcept
+{
+    // types only have a handful of fields, a linear scan beats hashing here
+    for (const Column& column : _columns)
+    {
+        if (column.offset == offset)
+        {
+            return &column;
+        }
+    }
+
+    return nullptr;
+}
+
+LuaColumnStore::Id LuaColumnStore::Create()
+{
+    if (_size == _capacity)
+    {
+        Grow();
+    }
+
+    Id id;
+    if (!_freeIds.empty())
+    {
+        id = _freeIds.back();
+        _freeIds.pop_back();
+    }
+    else
+    {
+        if (_rowOfId.size() >= InvalidIndex)
+        {
+            throw std::runtime_error("The column store has run out of ids.");
+        }
+
+        id = static_cast<Id>(_rowOfId.size());
+        _rowOfId.push_back(InvalidIndex);
+
+        // Destroy is noexcept, so make sure handing this id back later never needs to allocate
+        _freeIds.reserve(_rowOfId.size());
+    }
+
+    // reserve before constructing anything so the bookkeeping below can't throw halfway through
+    _idOfRow.reserve(_size + 1);
+
+    for (const Column& column : _columns)
+    {
+        column.type->construct(GetElement(column, _size));
+    }
+
+    _rowOfId[id] = static_cast<uint32_t>(_size);
+    _idOfRow.push_back(id);
+    ++_size;
+    return id;
+}
+
+void LuaColumnStore::Destroy(Id id) noexcept
+{
+    size_t row = _rowOfId[id];
+    size_t last = _size - 1;
+
+    for (const Column& column : _columns)
+    {
+        if (row != last)
+        {
+            column.type->moveAssign(GetElement(column, row), GetElement(column, last));
+        }
+
+        column.type->destroy(GetElement(column, last));
+    }
+
+    Id movedId = _idOfRow[last];
+    _idOfRow[row] = movedId;
+    _rowOfId[movedId] = static_cast<uint32_t>(row);
+    _idOfRow.pop_back();
+
+    _rowOfId[id] = InvalidIndex;
+    _freeIds.push_back(id);
+    --_size;
+}
+
+void* LuaColumnStore::GetFieldAddress(Id id, size_t offset) const noexcept
+{
+    const Column* column = FindColumn(offset);
+    return column != nullptr ? GetElement(*column, _rowOfId[id]) : nullptr;
+}
+
+void* LuaColumnStore::GetColumnData(size_t offset, const LuaFieldType& type) const noexcept
+{
+    const Column* column = FindColumn(offset);
+    return column != nullptr && column->type == &type ? column->data : nullptr;
+}
+
+void LuaColumnStore::Gather(Id id, void* object, size_t objectSize) const
+{
+    size_t row = _rowOfId[id];
+    for (const Column& column : _columns)
+    {
+        if (column.offset + column.type->size <= objectSize)
+        {
+            column.type->copyAssign(static_cast<std::byte*>(object) + column.offset, GetElement(column, row));
+        }
+    }
+}
+
+void LuaColumnStore::Scatter(Id id, const void* object, size_t objectSize)
+{
+    size_t row = _rowOfId[id];
+    for (const Column& column : _columns)
+    {
+        if (column.offset + column.type->size <= objectSize)
+        {
+            column.type->copyAssign(GetElement(column, row), static_cast<const std::byte*>(object) + column.offset);
+        }
+    }
+}
\ No newline at end of file
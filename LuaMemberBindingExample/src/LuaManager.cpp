@@ -1,31 +1,371 @@
-// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
-// for more information.
-
-#include <stdexcept>
-#include <LuaManager.hpp>
-#include <LuaTypeRegistry.hpp>
-
-LuaManager::LuaManager() : L(luaL_newstate())
-{
-    luaL_openlibs(L);
-}
-
-LuaManager::~LuaManager()
-{
-    lua_close(L);
-}
-
-void LuaManager::Execute(std::string code)
-{
-    if (luaL_dostring(L, code.c_str()) != LUA_OK)
-    {
-        auto str = lua_tostring(L, -1);
-        throw std::runtime_error(std::string(str));
-    }
-    // TODO: error handling
-}
-
-void LuaManager::SetGlobal(std::string name)
-{
-    lua_setglobal(L, name.c_str());
-}
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <LuaManager.hpp>
+#include <LuaTypeRegistry.hpp>
+
+LuaManager::LuaManager()
+    : L(luaL_newstate()), _compiledChunks(), _compiledSources(), _executedChunks(), _executedIndex(), _executeCacheCapacity(DefaultExecuteCacheCapacity), _bytecodeCache(), _scheduler(), _samplingProfiler(), _gcTelemetry(), _currentCycleTime(0), _gcMode(LuaGcMode::Incremental)
+{
+    luaL_openlibs(L);
+    InstallGcTelemetry();
+}
+
+LuaManager::LuaManager(lua_Alloc allocator, void* userData)
+    : L(lua_newstate(allocator, userData)), _compiledChunks(), _compiledSources(), _executedChunks(), _executedIndex(), _executeCacheCapacity(DefaultExecuteCacheCapacity), _bytecodeCache(), _scheduler(), _samplingProfiler(), _gcTelemetry(), _currentCycleTime(0), _gcMode(LuaGcMode::Incremental)
+{
+    if (L == nullptr)
+    {
+        throw std::runtime_error("Failed to create a Lua state with the given allocator.");
+    }
+
+    // luaL_newstate installs a panic handler and a warning function for us, lua_newstate does not
+    lua_atpanic(L, Panic);
+    lua_setwarnf(L, WarnOff, L);
+    luaL_openlibs(L);
+    InstallGcTelemetry();
+}
+
+LuaManager::LuaManager(LuaPoolAllocator& allocator) : LuaManager(LuaPoolAllocator::Allocate, &allocator)
+{}
+
+void LuaManager::InstallGcTelemetry()
+{
+    // CleanupObject counts straight into the telemetry through this pointer
+    lua_pushlightuserdata(L, &_gcTelemetry.finalizedObjects);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &LuaFinalizedObjectCounterKey);
+}
+
+int LuaManager::Panic(lua_State* L)
+{
+    const char* message = lua_tostring(L, -1);
+    std::fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", message ? message : "error object is not a string");
+    return 0;
+}
+
+bool LuaManager::HandleWarningControl(lua_State* L, const char* message, int toContinue)
+{
+    if (toContinue || message[0] != '@')
+    {
+        return false;
+    }
+
+    if (std::strcmp(message + 1, "off") == 0)
+    {
+        lua_setwarnf(L, WarnOff, L);
+    }
+    else if (std::strcmp(message + 1, "on") == 0)
+    {
+        lua_setwarnf(L, WarnOn, L);
+    }
+
+    return true;
+}
+
+void LuaManager::WarnOff(void* userData, const char* message, int toContinue)
+{
+    static_cast<void>(HandleWarningControl(static_cast<lua_State*>(userData), message, toContinue));
+}
+
+void LuaManager::WarnOn(void* userData, const char* message, int toContinue)
+{
+    if (HandleWarningControl(static_cast<lua_State*>(userData), message, toContinue))
+    {
+        return;
+    }
+
+    std::fputs("Lua warning: ", stderr);
+    WarnContinue(userData, message, toContinue);
+}
+
+void LuaManager::WarnContinue(void* userData, const char* message, int toContinue)
+{
+    lua_State* L = static_cast<lua_State*>(userData);
+    std::fputs(message, stderr);
+
+    // a message can come in several parts, only the last one ends the line
+    if (toContinue)
+    {
+        lua_setwarnf(L, WarnContinue, L);
+    }
+    else
+    {
+        std::fputs("\n", stderr);
+        lua_setwarnf(L, WarnOn, L);
+    }
+
+    std::fflush(stderr);
+}
+
+LuaManager::~LuaManager()
+{
+    // the scheduler and profiler unregister themselves from the state, so they have to go first
+    _samplingProfiler.reset();
+    _scheduler.reset();
+    lua_close(L);
+}
+
+void LuaManager::EnableBytecodeCache(std::filesystem::path directory)
+{
+    _bytecodeCache.emplace(std::move(directory));
+}
+
+LuaManager::ChunkHandle LuaManager::Load(std::string_view code)
+{
+    // same chunk name luaL_dostring would have used, so error messages don't change
+    std::string source(code);
+    int status = _bytecodeCache
+        ? _bytecodeCache->Load(L, source, source.c_str())
+        : luaL_loadbuffer(L, source.data(), source.size(), source.c_str());
+
+    if (status != LUA_OK)
+    {
+        std::string message(lua_tostring(L, -1));
+        lua_pop(L, 1);
+        throw std::runtime_error(message);
+    }
+
+    return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+LuaManager::ChunkHandle LuaManager::Compile(std::string_view code)
+{
+    auto it = _compiledChunks.find(code);
+    if (it != _compiledChunks.end())
+    {
+        return it->second;
+    }
+
+    ChunkHandle chunk = Load(code);
+    it = _compiledChunks.emplace(std::string(code), chunk).first;
+    _compiledSources.emplace(chunk, it->first);
+    return chunk;
+}
+
+void LuaManager::CallChunk()
+{
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK)
+    {
+        std::string message(lua_tostring(L, -1));
+        lua_pop(L, 1);
+        throw std::runtime_error(message);
+    }
+}
+
+void LuaManager::Run(ChunkHandle chunk)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, chunk);
+    CallChunk();
+}
+
+void LuaManager::Release(ChunkHandle chunk)
+{
+    auto it = _compiledSources.find(chunk);
+    if (it == _compiledSources.end())
+    {
+        throw std::runtime_error("This chunk was not compiled by this Lua manager or has already been released.");
+    }
+
+    _compiledChunks.erase(_compiledChunks.find(it->second));
+    _compiledSources.erase(it);
+    luaL_unref(L, LUA_REGISTRYINDEX, chunk);
+}
+
+void LuaManager::PushExecutedChunk(std::string_view code)
+{
+    auto compiled = _compiledChunks.find(code);
+    if (compiled != _compiledChunks.end())
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, compiled->second);
+        return;
+    }
+
+    auto executed = _executedIndex.find(code);
+    if (executed != _executedIndex.end())
+    {
+        // most recently used goes first
+        _executedChunks.splice(_executedChunks.begin(), _executedChunks, executed->second);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, executed->second->chunk);
+        return;
+    }
+
+    ChunkHandle chunk = Load(code);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, chunk);
+    if (_executeCacheCapacity == 0)
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, chunk);
+        return;
+    }
+
+    EvictExecutedChunks(_executeCacheCapacity - 1);
+    _executedChunks.push_front(ExecutedChunk{std::string(code), chunk});
+    _executedIndex.emplace(_executedChunks.front().source, _executedChunks.begin());
+}
+
+void LuaManager::Execute(std::string_view code)
+{
+    PushExecutedChunk(code);
+    CallChunk();
+}
+
+void LuaManager::EvictExecutedChunks(size_t keep)
+{
+    while (_executedChunks.size() > keep)
+    {
+        const ExecutedChunk& oldest = _executedChunks.back();
+        _executedIndex.erase(oldest.source);
+        luaL_unref(L, LUA_REGISTRYINDEX, oldest.chunk);
+        _executedChunks.pop_back();
+    }
+}
+
+void LuaManager::SetExecuteCacheCapacity(size_t capacity)
+{
+    EvictExecutedChunks(capacity);
+    _executeCacheCapacity = capacity;
+}
+
+LuaScheduler::TaskId LuaManager::Spawn(std::string_view code)
+{
+    LuaScheduler& scheduler = GetScheduler();
+
+    PushExecutedChunk(code);
+    return scheduler.Spawn();
+}
+
+LuaScheduler& LuaManager::GetScheduler()
+{
+    if (!_scheduler)
+    {
+        _scheduler = std::make_unique<LuaScheduler>(L);
+    }
+
+    return *_scheduler;
+}
+
+void LuaManager::SetGcMode(LuaGcMode mode)
+{
+    lua_gc(L, mode == LuaGcMode::Generational ? LUA_GCGEN : LUA_GCINC, 0, 0, 0);
+    _gcMode = mode;
+}
+
+void LuaManager::SetIncrementalGcParameters(int pause, int stepMultiplier, int stepSize)
+{
+    // LUA_GCINC also switches the collector to incremental mode if it wasn't already
+    lua_gc(L, LUA_GCINC, pause, stepMultiplier, stepSize);
+    _gcMode = LuaGcMode::Incremental;
+}
+
+void LuaManager::SetGenerationalGcParameters(int minorMultiplier, int majorMultiplier)
+{
+    lua_gc(L, LUA_GCGEN, minorMultiplier, majorMultiplier);
+    _gcMode = LuaGcMode::Generational;
+}
+
+void LuaManager::SetGcRunning(bool running)
+{
+    lua_gc(L, running ? LUA_GCRESTART : LUA_GCSTOP);
+}
+
+bool LuaManager::IsGcRunning() const
+{
+    return lua_gc(L, LUA_GCISRUNNING) != 0;
+}
+
+size_t LuaManager::GetMemoryUsage() const
+{
+    return static_cast<size_t>(lua_gc(L, LUA_GCCOUNT)) * 1024 + static_cast<size_t>(lua_gc(L, LUA_GCCOUNTB));
+}
+
+bool LuaManager::Step(std::chrono::microseconds budget)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + budget;
+    size_t memoryBefore = GetMemoryUsage();
+
+    bool cycleCompleted = false;
+    if (_gcMode == LuaGcMode::Generational)
+    {
+        // a generational step is a whole collection and never reports the end of a cycle, looping would just run
+        // collection after collection until the budget is gone
+        lua_gc(L, LUA_GCSTEP, 0);
+        ++_gcTelemetry.stepCount;
+        cycleCompleted = true;
+    }
+    else
+    {
+        do
+        {
+            // a data of 0 asks for a single basic step
+            cycleCompleted = lua_gc(L, LUA_GCSTEP, 0) != 0;
+            ++_gcTelemetry.stepCount;
+        } while (!cycleCompleted && Clock::now() < deadline);
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    size_t memoryAfter = GetMemoryUsage();
+
+    // finalizers can allocate, so memory may well have grown instead
+    _gcTelemetry.bytesFreed += memoryBefore > memoryAfter ? memoryBefore - memoryAfter : 0;
+    _gcTelemetry.stepTime += elapsed;
+    _currentCycleTime += elapsed;
+
+    if (cycleCompleted)
+    {
+        ++_gcTelemetry.cycleCount;
+        _gcTelemetry.lastCycleTime = std::exchange(_currentCycleTime, std::chrono::nanoseconds(0));
+    }
+
+    return cycleCompleted;
+}
+
+void LuaManager::Collect()
+{
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    size_t memoryBefore = GetMemoryUsage();
+
+    lua_gc(L, LUA_GCCOLLECT);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    size_t memoryAfter = GetMemoryUsage();
+
+    _gcTelemetry.bytesFreed += memoryBefore > memoryAfter ? memoryBefore - memoryAfter : 0;
+    ++_gcTelemetry.cycleCount;
+    _gcTelemetry.lastCycleTime = elapsed;
+    _gcTelemetry.stepTime += elapsed;
+    _currentCycleTime = std::chrono::nanoseconds(0);
+}
+
+void LuaManager::StartSampling(std::chrono::microseconds interval)
+{
+    if (_samplingProfiler)
+    {
+        throw std::runtime_error("This Lua state is already being sampled.");
+    }
+
+    _samplingProfiler = std::make_unique<LuaSamplingProfiler>(L, interval);
+}
+
+void LuaManager::StopSampling(std::ostream& collapsedStacks)
+{
+    if (!_samplingProfiler)
+    {
+        throw std::runtime_error("This Lua state is not being sampled.");
+    }
+
+    _samplingProfiler->WriteCollapsedStacks(collapsedStacks);
+    _samplingProfiler.reset();
+}
+
+void LuaManager::SetGlobal(std::string name)
+{
+    lua_setglobal(L, name.c_str());
+}
@@ -0,0 +1,184 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <algorithm>
+#include <bit>
+#include <LuaMemberProfiler.hpp>
+#include <LuaPoolAllocator.hpp>
+
+namespace
+{
+    const char* GetEventName(LuaProfiledEvent event) noexcept
+    {
+        switch (event)
+        {
+        case LuaProfiledEvent::Index:
+            return "__index";
+        case LuaProfiledEvent::NewIndex:
+            return "__newindex";
+        case LuaProfiledEvent::FreeFunction:
+            return "FreeFunction";
+        case LuaProfiledEvent::Create:
+            return "Create";
+        }
+
+        return "Unknown";
+    }
+
+    uint64_t GetPercentile(const LuaMemberProfiler::Statistics& statistics, uint64_t callCount, double fraction) noexcept
+    {
+        uint64_t target = static_cast<uint64_t>(static_cast<double>(callCount) * fraction);
+        uint64_t seen = 0;
+
+        for (size_t bucket = 0; bucket < LuaMemberProfiler::Statistics::BucketCount; ++bucket)
+        {
+            seen += statistics.histogram[bucket].load(std::memory_order_relaxed);
+            if (seen > target)
+            {
+                return bucket < 64 ? uint64_t(1) << bucket : UINT64_MAX;
+            }
+        }
+
+        return UINT64_MAX;
+    }
+
+    size_t GetAllocationCount(const void* allocator) noexcept
+    {
+        return allocator != nullptr
+            ? static_cast<const LuaPoolAllocator*>(allocator)->GetStatistics().allocationCount
+            : 0;
+    }
+}
+
+LuaMemberProfiler::Timer::Timer(Statistics* statistics, lua_State* L) noexcept
+    : _statistics(statistics), _allocator(nullptr), _allocationsBefore(0), _start()
+{
+    if (_statistics == nullptr)
+    {
+        return;
+    }
+
+    void* userData;
+    if (lua_getallocf(L, &userData) == LuaPoolAllocator::Allocate)
+    {
+        _allocator = userData;
+        _allocationsBefore = GetAllocationCount(_allocator);
+    }
+
+    _start = std::chrono::steady_clock::now();
+}
+
+void LuaMemberProfiler::Timer::Stop() const noexcept
+{
+    if (_statistics == nullptr)
+    {
+        return;
+    }
+
+    uint64_t nanoseconds = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count());
+
+    _statistics->callCount.fetch_add(1, std::memory_order_relaxed);
+    _statistics->totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    _statistics->histogram[static_cast<size_t>(std::bit_width(nanoseconds))].fetch_add(1, std::memory_order_relaxed);
+    _statistics->allocationCount.fetch_add(GetAllocationCount(_allocator) - _allocationsBefore, std::memory_order_relaxed);
+}
+
+void LuaMemberProfiler::Register(LuaProfiledEvent event, std::string_view name)
+{
+    auto& entries = _statistics[static_cast<size_t>(event)];
+    if (entries.find(name) == entries.end())
+    {
+        entries.emplace(std::string(name), std::make_unique<Statistics>());
+    }
+}
+
+LuaMemberProfiler::Statistics* LuaMemberProfiler::Find(LuaProfiledEvent event, std::string_view name) const noexcept
+{
+    const auto& entries = _statistics[static_cast<size_t>(event)];
+    auto it = entries.find(name);
+    return it != entries.end() ? it->second.get() : nullptr;
+}
+
+std::vector<LuaMemberProfiler::Entry> LuaMemberProfiler::GetReport() const
+{
+    std::vector<Entry> report;
+
+    for (size_t event = 0; event < EventCount; ++event)
+    {
+        for (const auto& [name, statistics] : _statistics[event])
+        {
+            uint64_t callCount = statistics->callCount.load(std::memory_order_relaxed);
+            if (callCount == 0)
+            {
+                continue;
+            }
+
+            report.push_back(Entry{
+                static_cast<LuaProfiledEvent>(event),
+                name,
+                callCount,
+                statistics->totalNanoseconds.load(std::memory_order_relaxed),
+                GetPercentile(*statistics, callCount, 0.5),
+                GetPercentile(*statistics, callCount, 0.9),
+                GetPercentile(*statistics, callCount, 0.99),
+                statistics->allocationCount.load(std::memory_order_relaxed)});
+        }
+    }
+
+    std::sort(report.begin(), report.end(), [](const Entry& lhs, const Entry& rhs) {
+        return lhs.totalNanoseconds > rhs.totalNanoseconds;
+    });
+
+    return report;
+}
+
+void LuaMemberProfiler::Reset() const noexcept
+{
+    for (const auto& entries : _statistics)
+    {
+        for (const auto& pair : entries)
+        {
+            Statistics& statistics = *pair.second;
+            statistics.callCount.store(0, std::memory_order_relaxed);
+            statistics.totalNanoseconds.store(0, std::memory_order_relaxed);
+            statistics.allocationCount.store(0, std::memory_order_relaxed);
+
+            for (auto& bucket : statistics.histogram)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void LuaMemberProfiler::PushReport(lua_State* L) const
+{
+    std::vector<Entry> report = GetReport();
+
+    lua_createtable(L, static_cast<int>(report.size()), 0);
+    for (size_t i = 0; i < report.size(); ++i)
+    {
+        const Entry& entry = report[i];
+
+        lua_createtable(L, 0, 8);
+        lua_pushstring(L, GetEventName(entry.event));
+        lua_setfield(L, -2, "Event");
+        lua_pushlstring(L, entry.name.data(), entry.name.size());
+        lua_setfield(L, -2, "Name");
+        lua_pushinteger(L, static_cast<lua_Integer>(entry.callCount));
+        lua_setfield(L, -2, "Calls");
+        lua_pushinteger(L, static_cast<lua_Integer>(entry.totalNanoseconds));
+        lua_setfield(L, -2, "TotalNanoseconds");
+        lua_pushinteger(L, static_cast<lua_Integer>(entry.p50Nanoseconds));
+        lua_setfield(L, -2, "P50Nanoseconds");
+        lua_pushinteger(L, static_cast<lua_Integer>(entry.p90Nanoseconds));
+        lua_setfield(L, -2, "P90Nanoseconds");
+        lua_pushinteger(L, static_cast<lua_Integer>(entry.p99Nanoseconds));
+        lua_setfield(L, -2, "P99Nanoseconds");
+        lua_pushinteger(L, static_cast<lua_Integer>(entry.allocationCount));
+        lua_setfield(L, -2, "Allocations");
+
+        lua_rawseti(L, -2, static_cast<lua_Integer>(i + 1));
+    }
+}
\ No newline at end of file
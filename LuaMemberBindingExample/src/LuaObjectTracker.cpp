@@ -0,0 +1,62 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <stdexcept>
+#include <LuaObjectTracker.hpp>
+
+LuaObjectTracker::LuaObjectTracker() noexcept : _slots(), _firstFree(InvalidSlot), _trackedCount(0)
+{}
+
+LuaObjectTracker::Handle LuaObjectTracker::Track(void* object, const void* type)
+{
+    if (object == nullptr)
+    {
+        throw std::runtime_error("Cannot track a null object.");
+    }
+
+    uint32_t slot;
+    if (_firstFree != InvalidSlot)
+    {
+        slot = _firstFree;
+        _firstFree = _slots[slot].nextFree;
+    }
+    else
+    {
+        if (_slots.size() == InvalidSlot)
+        {
+            throw std::runtime_error("Too many tracked objects.");
+        }
+
+        slot = static_cast<uint32_t>(_slots.size());
+        _slots.push_back(Slot{nullptr, nullptr, 0, InvalidSlot});
+    }
+
+    _slots[slot].object = object;
+    _slots[slot].type = type;
+    ++_trackedCount;
+    return Handle{slot, _slots[slot].generation};
+}
+
+void LuaObjectTracker::Untrack(Handle handle) noexcept
+{
+    if (Resolve(handle) == nullptr)
+    {
+        return;
+    }
+
+    Slot& slot = _slots[handle.slot];
+    slot.object = nullptr;
+    slot.type = nullptr;
+    ++slot.generation;
+    slot.nextFree = _firstFree;
+    _firstFree = handle.slot;
+    --_trackedCount;
+}
+
+void LuaObjectTracker::Retarget(Handle handle, void* object, const void* type) noexcept
+{
+    if (Resolve(handle) != nullptr && _slots[handle.slot].type == type && object != nullptr)
+    {
+        _slots[handle.slot].object = object;
+    }
+}
\ No newline at end of file
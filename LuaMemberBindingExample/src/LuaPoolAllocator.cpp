@@ -0,0 +1,143 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <LuaPoolAllocator.hpp>
+#include <new>
+
+LuaPoolAllocator::LuaPoolAllocator(size_t arenaBlockSize) noexcept
+    : _freeLists(),
+        _arenaBlocks(),
+        _arenaBlockSize(std::max(arenaBlockSize, MaxPooledSize)),
+        _arenaCursor(nullptr),
+        _arenaRemaining(0),
+        _statistics()
+    {}
+
+void* LuaPoolAllocator::AllocateBlock(size_t size) noexcept
+{
+    if (!IsPooled(size))
+    {
+        return std::malloc(size);
+    }
+
+    size_t sizeClass = GetSizeClass(size);
+    if (FreeSlot* slot = _freeLists[sizeClass])
+    {
+        _freeLists[sizeClass] = slot->next;
+        ++_statistics.pooledAllocationCount;
+        return slot;
+    }
+
+    size_t slotSize = (sizeClass + 1) * Granularity;
+    if (_arenaRemaining < slotSize)
+    {
+        // the tail of the old block is simply abandoned, it's less than one slot of the requested class
+        std::unique_ptr<std::byte[]> block(new (std::nothrow) std::byte[_arenaBlockSize]);
+        if (!block)
+        {
+            return nullptr;
+        }
+
+        _arenaCursor = block.get();
+        _arenaRemaining = _arenaBlockSize;
+        _statistics.arenaBytes += _arenaBlockSize;
+
+        try
+        {
+            _arenaBlocks.push_back(std::move(block));
+        }
+        catch (...)
+        {
+            _arenaCursor = nullptr;
+            _arenaRemaining = 0;
+            _statistics.arenaBytes -= _arenaBlockSize;
+            return nullptr;
+        }
+    }
+
+    void* ptr = _arenaCursor;
+    _arenaCursor += slotSize;
+    _arenaRemaining -= slotSize;
+    ++_statistics.pooledAllocationCount;
+    return ptr;
+}
+
+void LuaPoolAllocator::FreeBlock(void* ptr, size_t size) noexcept
+{
+    if (!IsPooled(size))
+    {
+        std::free(ptr);
+        return;
+    }
+
+    size_t sizeClass = GetSizeClass(size);
+    FreeSlot* slot = static_cast<FreeSlot*>(ptr);
+    slot->next = _freeLists[sizeClass];
+    _freeLists[sizeClass] = slot;
+}
+
+void* LuaPoolAllocator::ReallocateBlock(void* ptr, size_t originalSize, size_t newSize) noexcept
+{
+    if (IsPooled(originalSize) && IsPooled(newSize) && GetSizeClass(originalSize) == GetSizeClass(newSize))
+    {
+        return ptr;
+    }
+
+    if (!IsPooled(originalSize) && !IsPooled(newSize))
+    {
+        return std::realloc(ptr, newSize);
+    }
+
+    void* newPtr = AllocateBlock(newSize);
+    if (newPtr == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::memcpy(newPtr, ptr, std::min(originalSize, newSize));
+    FreeBlock(ptr, originalSize);
+    return newPtr;
+}
+
+void* LuaPoolAllocator::Allocate(void* userData, void* ptr, size_t originalSize, size_t newSize) noexcept
+{
+    LuaPoolAllocator* self = static_cast<LuaPoolAllocator*>(userData);
+    Statistics& statistics = self->_statistics;
+
+    if (newSize == 0)
+    {
+        if (ptr != nullptr)
+        {
+            self->FreeBlock(ptr, originalSize);
+            statistics.liveBytes -= originalSize;
+            ++statistics.freeCount;
+        }
+
+        return nullptr;
+    }
+
+    void* result;
+    if (ptr == nullptr)
+    {
+        // originalSize holds the type of the object being allocated here, not a size
+        result = self->AllocateBlock(newSize);
+        originalSize = 0;
+        ++statistics.allocationCount;
+    }
+    else
+    {
+        result = self->ReallocateBlock(ptr, originalSize, newSize);
+        ++statistics.reallocationCount;
+    }
+
+    if (result != nullptr)
+    {
+        statistics.liveBytes = statistics.liveBytes - originalSize + newSize;
+        statistics.peakBytes = std::max(statistics.peakBytes, statistics.liveBytes);
+    }
+
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <LuaSamplingProfiler.hpp>
+
+const char LuaSamplingProfiler::RegistryKey = 0;
+
+namespace
+{
+    // instructions to wait once armed, 1 means the very next one
+    constexpr int HookCount = 1;
+
+    void AppendFrame(std::string& stack, lua_State* thread, lua_Debug& debug)
+    {
+        lua_getinfo(thread, "Sn", &debug);
+
+        std::string frame;
+        if (debug.what[0] == 'C')
+        {
+            frame.append(debug.name ? debug.name : "?").append(" [C]");
+        }
+        else if (debug.what[0] == 'm')
+        {
+            frame.append("main chunk (").append(debug.short_src).append(")");
+        }
+        else
+        {
+            frame.append(debug.name ? debug.name : "?")
+                .append(" (")
+                .append(debug.short_src)
+                .append(":")
+                .append(std::to_string(debug.linedefined))
+                .append(")");
+        }
+
+        // ';' separates frames in the output
+        std::replace(frame.begin(), frame.end(), ';', ':');
+
+        if (!stack.empty())
+        {
+            stack.push_back(';');
+        }
+
+        stack.append(frame);
+    }
+}
+
+LuaSamplingProfiler::LuaSamplingProfiler(lua_State* L, std::chrono::microseconds interval)
+    : L(L), _interval(interval), _stacks(), _sampleCount(0), _timer()
+{
+    if (_interval.count() <= 0)
+    {
+        throw std::runtime_error("The sampling interval must be positive.");
+    }
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &RegistryKey);
+    bool exists = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+
+    if (exists)
+    {
+        throw std::runtime_error("This Lua state is already being profiled.");
+    }
+
+    lua_pushlightuserdata(L, this);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &RegistryKey);
+
+    _timer = std::jthread([this](std::stop_token stopToken) {
+        RunTimer(stopToken);
+    });
+}
+
+LuaSamplingProfiler::~LuaSamplingProfiler()
+{
+    // once the timer is gone nothing can arm the hook again, so it is safe to clear it for good
+    _timer.request_stop();
+    _timer.join();
+
+    lua_sethook(L, nullptr, 0, 0);
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &RegistryKey);
+}
+
+void LuaSamplingProfiler::RunTimer(std::stop_token stopToken)
+{
+    std::mutex mutex;
+    std::condition_variable_any wakeUp;
+    std::unique_lock lock(mutex);
+
+    auto next = std::chrono::steady_clock::now() + _interval;
+    while (true)
+    {
+        // nothing ever notifies, so this only returns early when a stop is requested
+        wakeUp.wait_until(lock, stopToken, next, [] { return false; });
+        if (stopToken.stop_requested())
+        {
+            return;
+        }
+
+        // the return mask catches long running C functions, which execute no instructions to count
+        lua_sethook(L, Hook, LUA_MASKCOUNT | LUA_MASKRET, HookCount);
+        next += _interval;
+    }
+}
+
+void LuaSamplingProfiler::Hook(lua_State* L, lua_Debug*)
+{
+    // disarm first, so nothing the sample does can trigger another one
+    lua_sethook(L, nullptr, 0, 0);
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &RegistryKey);
+    LuaSamplingProfiler* profiler = static_cast<LuaSamplingProfiler*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+
+    if (profiler != nullptr)
+    {
+        profiler->Sample(L);
+    }
+}
+
+void LuaSamplingProfiler::Sample(lua_State* thread)
+{
+    // lua_getstack counts from the innermost frame, the output wants the outermost first
+    lua_Debug debug;
+    int depth = 0;
+    while (lua_getstack(thread, depth, &debug))
+    {
+        ++depth;
+    }
+
+    std::string stack;
+    for (int level = depth - 1; level >= 0; --level)
+    {
+        lua_getstack(thread, level, &debug);
+        AppendFrame(stack, thread, debug);
+    }
+
+    ++_stacks[stack];
+    ++_sampleCount;
+}
+
+void LuaSamplingProfiler::WriteCollapsedStacks(std::ostream& stream) const
+{
+    std::vector<std::pair<std::string_view, uint64_t>> stacks(_stacks.begin(), _stacks.end());
+    std::sort(stacks.begin(), stacks.end());
+
+    for (const auto& [stack, count] : stacks)
+    {
+        stream << (stack.empty() ? std::string_view("[no frames]") : stack) << ' ' << count << '\n';
+    }
+}
\ No newline at end of file
@@ -0,0 +1,351 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <LuaScheduler.hpp>
+
+const char LuaScheduler::RegistryKey = 0;
+thread_local const char* LuaScheduler::_waitError = nullptr;
+
+LuaScheduler::LuaScheduler(lua_State* L)
+    : L(L), _nextTask(1), _tasks(), _tasksByThread(), _timers(), _polled(), _runnable(), _errorHandler()
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &RegistryKey);
+    bool exists = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+
+    if (exists)
+    {
+        throw std::runtime_error("This Lua state already has a scheduler.");
+    }
+
+    lua_pushlightuserdata(L, this);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &RegistryKey);
+
+    lua_pushcfunction(L, Async<Sleep>);
+    lua_setglobal(L, "Sleep");
+
+    SetErrorHandler(nullptr);
+}
+
+LuaScheduler::~LuaScheduler()
+{
+    // unfinished tasks are simply dropped, the collector takes care of their threads
+    for (const auto& pair : _tasks)
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, pair.second.threadReference);
+    }
+
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &RegistryKey);
+}
+
+LuaScheduler* LuaScheduler::FromState(lua_State* L) noexcept
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &RegistryKey);
+    LuaScheduler* scheduler = static_cast<LuaScheduler*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    return scheduler;
+}
+
+LuaScheduler::Task* LuaScheduler::FindTask(lua_State* thread) noexcept
+{
+    LuaScheduler* scheduler = FromState(thread);
+    if (scheduler == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto it = scheduler->_tasksByThread.find(thread);
+    return it != scheduler->_tasksByThread.end() ? &scheduler->_tasks.at(it->second) : nullptr;
+}
+
+LuaScheduler::Task* LuaScheduler::FindWaitable(lua_State* thread) noexcept
+{
+    Task* task = FindTask(thread);
+    if (task == nullptr)
+    {
+        _waitError = "Waiting is only possible from inside a scheduled task.";
+        return nullptr;
+    }
+
+    if (!lua_isyieldable(thread))
+    {
+        _waitError = "A task cannot wait across a C call boundary.";
+        return nullptr;
+    }
+
+    return task;
+}
+
+bool LuaScheduler::IsWaiting(lua_State* thread) noexcept
+{
+    Task* task = FindTask(thread);
+    return task != nullptr && task->wait != WaitKind::None;
+}
+
+bool LuaScheduler::AwaitFor(lua_State* L, Clock::duration duration)
+{
+    return AwaitUntil(L, Clock::now() + duration);
+}
+
+bool LuaScheduler::AwaitUntil(lua_State* L, Clock::time_point deadline)
+{
+    Task* task = FindWaitable(L);
+    if (task == nullptr)
+    {
+        return false;
+    }
+
+    task->wait = WaitKind::Deadline;
+    task->deadline = deadline;
+    return true;
+}
+
+bool LuaScheduler::Await(lua_State* L, ReadyFunction ready, CompleteFunction complete)
+{
+    Task* task = FindWaitable(L);
+    if (task == nullptr)
+    {
+        return false;
+    }
+
+    task->wait = WaitKind::Polled;
+    task->ready = std::move(ready);
+    task->complete = std::move(complete);
+    return true;
+}
+
+int LuaScheduler::ResumeWait(lua_State* thread, int, lua_KContext)
+{
+    int results = 0;
+    bool failed = false;
+
+    // Everything with a destructor stays inside this block, so it is gone before lua_error unwinds past us.
+    {
+        // only ever called while this task is being resumed, so it exists
+        Task* task = FindTask(thread);
+        CompleteFunction complete = std::move(task->complete);
+        task->complete = nullptr;
+        task->ready = nullptr;
+
+        if (complete)
+        {
+            try
+            {
+                results = complete(thread);
+            }
+            catch (const std::exception& e)
+            {
+                lua_pushstring(thread, e.what());
+                failed = true;
+            }
+            catch (...)
+            {
+                lua_pushliteral(thread, "Unknown exception while completing a wait.");
+                failed = true;
+            }
+        }
+    }
+
+    if (failed)
+    {
+        return lua_error(thread);
+    }
+
+    return results;
+}
+
+int LuaScheduler::Sleep(lua_State* L)
+{
+    using Seconds = std::chrono::duration<lua_Number>;
+
+    // Converting a duration the clock can't represent is undefined, and the deadline must not overflow either, so
+    // anything longer than a year (math.huge included) is cut down to one. NaN fails both comparisons and becomes 0.
+    constexpr lua_Number LongestSleep = 365.0 * 24 * 60 * 60;
+    lua_Number seconds = luaL_checknumber(L, 1);
+    seconds = seconds > LongestSleep ? LongestSleep : (seconds > 0 ? seconds : 0);
+
+    static_cast<void>(AwaitFor(L, std::chrono::duration_cast<Clock::duration>(Seconds(seconds))));
+    return 0;
+}
+
+void LuaScheduler::SetErrorHandler(ErrorHandler handler)
+{
+    if (handler)
+    {
+        _errorHandler = std::move(handler);
+        return;
+    }
+
+    _errorHandler = [](TaskId id, const std::string& message) {
+        std::fprintf(stderr, "Lua task %llu failed: %s\n", static_cast<unsigned long long>(id), message.c_str());
+    };
+}
+
+LuaScheduler::TaskId LuaScheduler::Spawn()
+{
+    if (!lua_isfunction(L, -1))
+    {
+        throw std::runtime_error("Only functions can be spawned as Lua tasks.");
+    }
+
+    lua_State* thread = lua_newthread(L);
+    lua_pushvalue(L, -2);
+    lua_xmove(L, thread, 1);
+
+    // the registry reference is what keeps the thread alive while it is suspended
+    int threadReference = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pop(L, 1);
+
+    TaskId id = _nextTask++;
+    _tasks.emplace(id, Task{thread, threadReference, WaitKind::None, Clock::time_point(), nullptr, nullptr, {}});
+    _tasksByThread.emplace(thread, id);
+    _runnable.push_back(id);
+    return id;
+}
+
+size_t LuaScheduler::Update()
+{
+    Clock::time_point now = Clock::now();
+    while (!_timers.empty() && _timers.top().first <= now)
+    {
+        _runnable.push_back(_timers.top().second);
+        _timers.pop();
+    }
+
+    for (size_t i = 0; i < _polled.size();)
+    {
+        if (_tasks.at(_polled[i]).ready())
+        {
+            _runnable.push_back(_polled[i]);
+            _polled[i] = _polled.back();
+            _polled.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    // tasks that yield or get spawned while these run go into a fresh list and wait for the next Update
+    std::vector<TaskId> runnable;
+    runnable.swap(_runnable);
+
+    for (TaskId id : runnable)
+    {
+        Resume(id);
+    }
+
+    return _tasks.size();
+}
+
+void LuaScheduler::RunUntilIdle(Clock::duration polling)
+{
+    while (Update() > 0)
+    {
+        if (!_runnable.empty())
+        {
+            continue;
+        }
+
+        Clock::time_point wakeTime = _polled.empty() ? Clock::time_point::max() : Clock::now() + polling;
+        if (!_timers.empty())
+        {
+            wakeTime = std::min(wakeTime, _timers.top().first);
+        }
+
+        std::this_thread::sleep_until(wakeTime);
+    }
+}
+
+void LuaScheduler::Resume(TaskId id)
+{
+    // unordered_map nodes are stable, so this stays valid even if the task spawns others
+    Task& task = _tasks.at(id);
+    task.wait = WaitKind::None;
+
+    int resultCount = 0;
+    int status = lua_resume(task.thread, L, 0, &resultCount);
+
+    if (status == LUA_YIELD)
+    {
+        lua_pop(task.thread, resultCount);
+
+        switch (task.wait)
+        {
+        case WaitKind::Deadline:
+            _timers.emplace(task.deadline, id);
+            break;
+        case WaitKind::Polled:
+            _polled.push_back(id);
+            break;
+        case WaitKind::None:
+            // a plain coroutine.yield(), so just give everyone else a turn first
+            _runnable.push_back(id);
+            break;
+        }
+
+        return;
+    }
+
+    if (status == LUA_OK)
+    {
+        lua_settop(task.thread, 0);
+        Finish(id, nullptr);
+        return;
+    }
+
+    const char* message = lua_tostring(task.thread, -1);
+    std::string error(message ? message : "error object is not a string");
+    lua_resetthread(task.thread);
+    Finish(id, &error);
+}
+
+void LuaScheduler::Finish(TaskId id, const std::string* error)
+{
+    // take the task out first, so it is no longer alive by the time anything waiting on it runs
+    auto node = _tasks.extract(id);
+    Task& task = node.mapped();
+
+    _tasksByThread.erase(task.thread);
+    luaL_unref(L, LUA_REGISTRYINDEX, task.threadReference);
+
+    if (error && task.joiners.empty())
+    {
+        _errorHandler(id, *error);
+    }
+
+    for (JoinAwaiter* joiner : task.joiners)
+    {
+        if (error)
+        {
+            joiner->_error = *error;
+        }
+
+        joiner->_handle.resume();
+    }
+}
+
+bool LuaScheduler::JoinAwaiter::await_ready() const noexcept
+{
+    return !_scheduler.IsAlive(_task);
+}
+
+void LuaScheduler::JoinAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    _handle = handle;
+    _scheduler._tasks.at(_task).joiners.push_back(this);
+}
+
+void LuaScheduler::JoinAwaiter::await_resume() const
+{
+    if (_error)
+    {
+        throw std::runtime_error(*_error);
+    }
+}
\ No newline at end of file
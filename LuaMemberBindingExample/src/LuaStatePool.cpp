@@ -0,0 +1,286 @@
+// Copyright © Matt Jones and Contributors. Licensed under the MIT Licence (MIT). See LICENCE.md in the repository root
+// for more information.
+
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <LuaStatePool.hpp>
+
+LuaStatePool::LuaStatePool(size_t threadCount, SetupFunction setup)
+    : _workers(), _nextWorker(0), _mutex(), _workAvailable(), _allDone(), _stealableCount(0), _outstandingCount(0),
+      _firstError()
+{
+    if (threadCount == 0)
+    {
+        throw std::runtime_error("A Lua state pool needs at least one thread.");
+    }
+
+    // every worker has to exist before any thread starts looking for jobs to steal
+    _workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+
+    std::exception_ptr setupError;
+    std::latch ready(static_cast<std::ptrdiff_t>(threadCount));
+
+    size_t started = 0;
+    try
+    {
+        for (; started < threadCount; ++started)
+        {
+            size_t i = started;
+            _workers[i]->thread = std::jthread([this, i, &setup, &setupError, &ready](std::stop_token stopToken) {
+                Run(stopToken, i, setup, setupError, ready);
+            });
+        }
+    }
+    catch (...)
+    {
+        // the threads already running use setup, setupError and ready until they count down, so let them get past
+        // that before unwinding destroys all three
+        ready.count_down(static_cast<std::ptrdiff_t>(threadCount - started));
+        ready.wait();
+        Stop();
+        throw;
+    }
+
+    ready.wait();
+
+    if (setupError)
+    {
+        Stop();
+        std::rethrow_exception(setupError);
+    }
+}
+
+LuaStatePool::~LuaStatePool()
+{
+    Stop();
+}
+
+void LuaStatePool::Stop() noexcept
+{
+    // all workers have to be joined before any of them is destroyed, as they look into each other's queues
+    for (auto& worker : _workers)
+    {
+        worker->thread.request_stop();
+    }
+
+    for (auto& worker : _workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+void LuaStatePool::Run(std::stop_token stopToken, size_t workerIndex, const SetupFunction& setup,
+    std::exception_ptr& setupError, std::latch& ready)
+{
+    // the state is created, used and closed on this thread only
+    std::optional<LuaManager> manager;
+    bool setupSucceeded = false;
+
+    try
+    {
+        manager.emplace();
+        setup(*manager);
+        setupSucceeded = true;
+    }
+    catch (...)
+    {
+        std::scoped_lock lock(_mutex);
+        if (!setupError)
+        {
+            setupError = std::current_exception();
+        }
+    }
+
+    // setup, setupError and ready belong to the constructor and must not be touched after this
+    ready.count_down();
+
+    if (!setupSucceeded)
+    {
+        return;
+    }
+
+    Worker& worker = *_workers[workerIndex];
+    while (true)
+    {
+        bool pinned;
+        {
+            std::unique_lock lock(_mutex);
+            // Without this check the wait would keep returning true while jobs are queued, so stopping would drain
+            // them all. Whatever is left is destroyed along with the workers instead.
+            _workAvailable.wait(lock, stopToken, [this, &worker] { return worker.pinnedCount > 0 || _stealableCount > 0; });
+            if (stopToken.stop_requested())
+            {
+                return;
+            }
+
+            // claim the job now, it gets popped once the lock is dropped
+            pinned = worker.pinnedCount > 0;
+            if (pinned)
+            {
+                --worker.pinnedCount;
+            }
+            else
+            {
+                --_stealableCount;
+            }
+        }
+
+        Job job = Take(workerIndex, pinned);
+
+        try
+        {
+            job(*manager);
+        }
+        catch (...)
+        {
+            std::scoped_lock lock(_mutex);
+            if (!_firstError)
+            {
+                _firstError = std::current_exception();
+            }
+        }
+
+        worker.executedCount.fetch_add(1, std::memory_order_relaxed);
+
+        std::scoped_lock lock(_mutex);
+        if (--_outstandingCount == 0)
+        {
+            _allDone.notify_all();
+        }
+    }
+}
+
+void LuaStatePool::Push(size_t workerIndex, Job job, bool pinned)
+{
+    Worker& worker = *_workers[workerIndex];
+    {
+        std::scoped_lock lock(worker.mutex);
+        (pinned ? worker.pinnedJobs : worker.jobs).push_back(std::move(job));
+    }
+
+    // only published once it is in a queue, so a claimed job is always there to be taken
+    {
+        std::scoped_lock lock(_mutex);
+        ++_outstandingCount;
+
+        if (pinned)
+        {
+            ++worker.pinnedCount;
+        }
+        else
+        {
+            ++_stealableCount;
+        }
+    }
+
+    // pinned jobs need their own worker awake, which notify_one can't promise
+    if (pinned)
+    {
+        _workAvailable.notify_all();
+    }
+    else
+    {
+        _workAvailable.notify_one();
+    }
+}
+
+LuaStatePool::Job LuaStatePool::Take(size_t workerIndex, bool pinned)
+{
+    Worker& worker = *_workers[workerIndex];
+    Job job;
+
+    if (pinned)
+    {
+        std::scoped_lock lock(worker.mutex);
+        job = std::move(worker.pinnedJobs.front());
+        worker.pinnedJobs.pop_front();
+        return job;
+    }
+
+    // newest own job first, it is the most likely to still be warm in cache
+    {
+        std::scoped_lock lock(worker.mutex);
+        if (!worker.jobs.empty())
+        {
+            job = std::move(worker.jobs.back());
+            worker.jobs.pop_back();
+            return job;
+        }
+    }
+
+    // Then the oldest job of anyone else. A claim guarantees some queue holds a job for us, so keep going round until
+    // it turns up.
+    for (size_t offset = 1;; ++offset)
+    {
+        Worker& victim = *_workers[(workerIndex + offset) % _workers.size()];
+
+        std::scoped_lock lock(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+
+            if (&victim != &worker)
+            {
+                worker.stolenCount.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            return job;
+        }
+    }
+}
+
+void LuaStatePool::Submit(Job job)
+{
+    Push(_nextWorker.fetch_add(1, std::memory_order_relaxed) % _workers.size(), std::move(job), false);
+}
+
+void LuaStatePool::Submit(std::string code)
+{
+    // Execute keeps recently run chunks compiled per state, so resubmitting the same code only compiles it once per
+    // worker, while one-off scripts eventually get evicted
+    Submit([code = std::move(code)](LuaManager& manager) {
+        manager.Execute(code);
+    });
+}
+
+void LuaStatePool::SubmitTo(size_t workerIndex, Job job)
+{
+    if (workerIndex >= _workers.size())
+    {
+        throw std::runtime_error("There is no worker with this index in the Lua state pool.");
+    }
+
+    Push(workerIndex, std::move(job), true);
+}
+
+void LuaStatePool::Wait()
+{
+    std::unique_lock lock(_mutex);
+    _allDone.wait(lock, [this] { return _outstandingCount == 0; });
+
+    if (_firstError)
+    {
+        std::exception_ptr error = std::exchange(_firstError, nullptr);
+        std::rethrow_exception(error);
+    }
+}
+
+LuaStatePool::Statistics LuaStatePool::GetStatistics(size_t workerIndex) const
+{
+    if (workerIndex >= _workers.size())
+    {
+        throw std::runtime_error("There is no worker with this index in the Lua state pool.");
+    }
+
+    const Worker& worker = *_workers[workerIndex];
+    return Statistics{worker.executedCount.load(std::memory_order_relaxed), worker.stolenCount.load(std::memory_order_relaxed)};
+}
\ No newline at end of file
@@ -2,42 +2,30 @@
 #include <LuaManager.hpp>
 #include <LuaTypeRegistry.hpp>
 #include <ElementNode.hpp>
+#include <ElementNodeCache.hpp>
 
 int main(int, char**) {
 
-    LuaManager manager{};
+    // declared before the manager so they outlive it, closing the state still runs __gc through both of them
+    ElementNodeCache nodeCache{};
     LuaTypeRegistry<ElementNode> registry("ElementNode");
+    registry.SetObjectPool(nodeCache);
 
-    registry.RegisterMethod("SayHello", [](auto L) {
-        ElementNode* node = static_cast<ElementNode*>(
-            luaL_checkudata(L, 1, "ElementNode"));
-        node->SayHelloWorld();
-        return 0;
-    });
-    registry.RegisterMethod("SetPointlessBool", [](auto L) {
-        ElementNode* node = static_cast<ElementNode*>(
-            luaL_checkudata(L, 1, "ElementNode"));
-
-        node->SetPointlessBool(lua_toboolean(L, 2));
-        return 0;
-    });
-    registry.RegisterMethod("Add", [](auto L) {
-        ElementNode* node = static_cast<ElementNode*>(
-            luaL_checkudata(L, 1, "ElementNode"));
-
-        lua_pushinteger(L,
-            node->Add(
-                static_cast<int32_t>(luaL_checkinteger(L, 2)),
-                static_cast<int32_t>(luaL_checkinteger(L, 3))));
-        return 1;
-    });
+    registry.RegisterMethod<&ElementNode::SayHelloWorld>("SayHello");
+    registry.RegisterMethod<&ElementNode::SetPointlessBool>("SetPointlessBool");
+    registry.RegisterMethod<&ElementNode::Add>("Add");
+    registry.RegisterBatchMethod<&ElementNode::Add>("AddMany");
     registry.RegisterFreeFunction("SaySomething", [](auto) {
         std::cout << "Hello from C++ (really cool edition)!!!\n";
         return 0;
     });
     registry.RegisterField("PointlessBool", &ElementNode::pointlessBool);
+    registry.Finalize();
+
+    LuaManager manager{};
 
     manager.ApplyRegistry(registry);
+    manager.ApplyBufferType<int32_t>();
 
     auto node = manager.Instantiate(registry); // you can do stuff with the object here if you want. We're just casting to void to shut the compiler up.
     static_cast<void>(node);
@@ -55,5 +43,12 @@ int main(int, char**) {
     }
 
     manager.Execute("for i = 1, 10 do print(node:Add(i, 5)) end");
+    manager.Execute("local sums = node:AddMany({1, 2, 3}, {5, 5, 5}) print(sums[1], sums[2], sums[3])");
+
+    auto values = manager.AllocateBuffer<int32_t>(3);
+    values[0] = 1; values[1] = 2; values[2] = 3;
+    manager.SetGlobal("values");
+    manager.Execute("local tail = values:Slice(2) tail[1] = 20 print(#tail, values[2])");
+    manager.Execute("local doubled = Int32Buffer.Add(values, values) print(doubled[1], doubled[2], doubled[3])");
     */
 }